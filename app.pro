@@ -0,0 +1,71 @@
+# The game itself, built by battlecity.pro with the tools.
+
+TARGET = battlecity
+
+# Add more folders to ship with the application, here
+folder_01.source = qml/battlecity
+folder_01.target = qml
+DEPLOYMENTFOLDERS = folder_01
+
+# Additional import path used to resolve QML modules in Creator's code model
+QML_IMPORT_PATH = qml engine
+
+symbian:TARGET.UID3 = 0xE7ED4231
+
+# Smart Installer package's UID
+# This UID is from the protected range and therefore the package will
+# fail to install if self-signed. By default qmake uses the unprotected
+# range value if unprotected UID is defined for the application and
+# 0x2002CCCF value if protected UID is given to the application
+#symbian:DEPLOYMENT.installer_header = 0x2002CCCF
+
+# Allow network access on Symbian
+symbian:TARGET.CAPABILITY += NetworkServices
+
+# If your application uses the Qt Mobility libraries, uncomment the following
+# lines and add the respective components to the MOBILITY variable.
+# CONFIG += mobility
+# MOBILITY +=
+
+# Speed up launching on MeeGo/Harmattan when using applauncherd daemon
+# CONFIG += qdeclarative-boostable
+
+# Add dependency to Symbian components
+# CONFIG += qt-components
+
+# The .cpp file which was generated for your project. Feel free to hack it.
+SOURCES += main.cpp
+
+include(engine/engine.pri)
+
+# Please do not modify the following two lines. Required for deployment.
+include(qmlapplicationviewer/qmlapplicationviewer.pri)
+qtcAddDeployment()
+
+RESOURCES += \
+    battlecity.qrc
+
+# Textures pre-decoded by texturepacker, which battlecity.pro builds first:
+# the blob is written next to the build and embedded by rcc, so the game
+# maps it at startup. CONFIG += no_texture_blob builds without it (e.g. when
+# cross compiling), then the images are decoded at startup.
+!no_texture_blob {
+    TEXTUREPACKER = $$OUT_PWD/texturepacker/texturepacker
+    win32 {
+        CONFIG(debug, debug|release): TEXTUREPACKER = $$OUT_PWD/texturepacker/debug/texturepacker.exe
+        else: TEXTUREPACKER = $$OUT_PWD/texturepacker/release/texturepacker.exe
+    }
+
+    QMAKE_SUBSTITUTES += textures.qrc.in
+    TEXTURE_RESOURCES = $$OUT_PWD/textures.qrc
+
+    texturepack.input = TEXTURE_RESOURCES
+    texturepack.output = qrc_${QMAKE_FILE_BASE}.cpp
+    texturepack.commands = $$TEXTUREPACKER $$OUT_PWD/textures.bctx && \
+                           $$QMAKE_RCC -name ${QMAKE_FILE_BASE} ${QMAKE_FILE_IN} -o ${QMAKE_FILE_OUT}
+    texturepack.depends = $$TEXTUREPACKER
+    texturepack.variable_out = SOURCES
+    QMAKE_EXTRA_COMPILERS += texturepack
+}
+
+#DEFINES += BC_DEBUG_RECT
@@ -0,0 +1,106 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include "bcanimator.h"
+#include "bcitem.h"
+
+// Ticks are 30 ms: 8 of them are the 250 ms of the original blinking.
+const BCAnimator::Definition BCAnimator::definitions[AnimationsCount] = {
+    { 2, 8, true },     // BonusBlink
+    { 2, 8, true },     // ArmorFlash
+    { 2, 2, true }      // ShieldBlink
+};
+
+BCAnimator::BCAnimator() :
+    m_tick(0)
+{
+
+}
+
+int BCAnimator::indexOf(const BCItem *item, Animation animation) const
+{
+    for (int i = 0; i < m_instances.count(); ++i) {
+        const Instance &instance = m_instances.at(i);
+        if (instance.item == item && instance.animation == animation)
+            return i;
+    }
+    return -1;
+}
+
+void BCAnimator::remove(int index)
+{
+    // Order does not matter: the last entry takes the place of the removed one.
+    BCItem *item = m_instances.at(index).item;
+    m_instances[index] = m_instances.last();
+    m_instances.resize(m_instances.count() - 1);
+    item->update();
+}
+
+void BCAnimator::start(BCItem *item, Animation animation, quint32 endTick)
+{
+    // Restored board states start again what runs already.
+    const int index = indexOf(item, animation);
+    if (index >= 0) {
+        m_instances[index].endTick = endTick;
+        return;
+    }
+    Instance instance;
+    instance.item = item;
+    instance.animation = animation;
+    instance.frame = 0;
+    instance.startTick = m_tick;
+    instance.endTick = endTick;
+    m_instances.append(instance);
+    item->update();
+}
+
+void BCAnimator::stop(BCItem *item, Animation animation)
+{
+    const int index = indexOf(item, animation);
+    if (index >= 0)
+        remove(index);
+}
+
+int BCAnimator::frame(const BCItem *item, Animation animation) const
+{
+    const int index = indexOf(item, animation);
+    return index < 0 ? -1 : m_instances.at(index).frame;
+}
+
+void BCAnimator::advance(quint32 tick)
+{
+    m_tick = tick;
+    for (int i = 0; i < m_instances.count();) {
+        Instance &instance = m_instances[i];
+        if (instance.endTick && tick >= instance.endTick) {
+            remove(i);
+            continue;
+        }
+        const Definition &definition = definitions[instance.animation];
+        // A restored board state can move the clock back.
+        const quint32 elapsed = tick > instance.startTick ? tick - instance.startTick : 0;
+        quint32 frame = elapsed / definition.frameTicks;
+        if (definition.loop)
+            frame %= definition.frames;
+        else
+            frame = qMin(frame, quint32(definition.frames - 1));
+        if (frame != instance.frame) {
+            instance.frame = frame;
+            instance.item->update();
+        }
+        ++i;
+    }
+}
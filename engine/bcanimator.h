@@ -0,0 +1,79 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCANIMATOR_H
+#define BCANIMATOR_H
+
+#include <QVector>
+
+class BCItem;
+
+// Sprite animations of the board items on one clock, the board tick. An
+// animation is a row of the definition table; an item running one is an
+// entry of a flat list, and advance() walks that list once per tick,
+// repainting only the items whose frame changed. Animations are looks
+// only: they are not part of the board state.
+class BCAnimator
+{
+public:
+    enum Animation {
+        BonusBlink,     // enemy carrying a power-up: bonus look, plain look
+        ArmorFlash,     // armor tank two hits from the end: green, gold
+        ShieldBlink,    // shield of a respawned player tank
+        AnimationsCount
+    };
+
+    struct Definition
+    {
+        quint8 frames;
+        quint8 frameTicks;
+        bool loop;          // the last frame stays on otherwise
+    };
+
+    static const Definition definitions[AnimationsCount];
+
+    BCAnimator();
+
+    // Starts the animation of the item on its first frame, a running one
+    // goes on. It stops by itself at the end tick, if any.
+    void start(BCItem *item, Animation animation, quint32 endTick = 0);
+    void stop(BCItem *item, Animation animation);
+
+    // Current frame of the animation of the item, -1 when it does not run.
+    int frame(const BCItem *item, Animation animation) const;
+
+    void advance(quint32 tick);
+
+    int activeCount() const { return m_instances.count(); }
+
+private:
+    int indexOf(const BCItem *item, Animation animation) const;
+    void remove(int index);
+
+    struct Instance
+    {
+        BCItem *item;
+        quint8 animation;
+        quint8 frame;
+        quint32 startTick;
+        quint32 endTick;
+    };
+
+    QVector<Instance> m_instances;
+    quint32 m_tick;
+};
+
+#endif // BCANIMATOR_H
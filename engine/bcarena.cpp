@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <stdlib.h>
+
+#include "bcarena.h"
+
+static const int alignment = 16;
+
+static inline int alignedSize(int size)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+BCArena::BCArena(int blockSize) :
+    m_blockSize(alignedSize(qMax(blockSize, alignment))),
+    m_offset(0),
+    m_used(0)
+{
+
+}
+
+BCArena::~BCArena()
+{
+    clear();
+}
+
+void *BCArena::allocate(int size)
+{
+    size = alignedSize(qMax(size, 1));
+    if (m_blocks.isEmpty() || m_offset + size > m_blocks.last().size)
+        appendBlock(qMax(size, m_blocks.isEmpty() ? m_blockSize : 2 * m_blocks.last().size));
+
+    void *ptr = m_blocks.last().data + m_offset;
+    m_offset += size;
+    m_used += size;
+    return ptr;
+}
+
+void BCArena::reset()
+{
+    if (m_blocks.count() > 1) {
+        // The level did not fit into one block: coalesce, so the next level
+        // of the same size is served without touching the heap again.
+        const int size = capacity();
+        clear();
+        appendBlock(size);
+    }
+    m_offset = 0;
+    m_used = 0;
+}
+
+int BCArena::capacity() const
+{
+    int size = 0;
+    for (int i = 0; i < m_blocks.count(); ++i)
+        size += m_blocks[i].size;
+    return size;
+}
+
+void BCArena::appendBlock(int size)
+{
+    Block block;
+    block.data = static_cast<char *>(::malloc(size));
+    Q_CHECK_PTR(block.data);
+    block.size = size;
+    m_blocks.append(block);
+    m_offset = 0;
+}
+
+void BCArena::clear()
+{
+    for (int i = 0; i < m_blocks.count(); ++i)
+        ::free(m_blocks[i].data);
+    m_blocks.clear();
+    m_offset = 0;
+}
@@ -0,0 +1,63 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCARENA_H
+#define BCARENA_H
+
+#include <QVarLengthArray>
+
+// Monotonic buffer for per-level plain data, such as the board's cell grid.
+// Memory is never freed piecewise: reset() releases everything in one shot and
+// keeps a single block large enough for the next level of the same size.
+class BCArena
+{
+public:
+    explicit BCArena(int blockSize = 4096);
+    ~BCArena();
+
+    void *allocate(int size);
+
+    template <typename T>
+    T *allocate(int count)
+    {
+        return static_cast<T *>(allocate(count * int(sizeof(T))));
+    }
+
+    void reset();
+
+    int capacity() const;
+    int used() const { return m_used; }
+    int blocksCount() const { return m_blocks.count(); }
+
+private:
+    Q_DISABLE_COPY(BCArena)
+
+    void appendBlock(int size);
+    void clear();
+
+    struct Block
+    {
+        char *data;
+        int size;
+    };
+
+    QVarLengthArray<Block, 4> m_blocks;
+    int m_blockSize;
+    int m_offset;
+    int m_used;
+};
+
+#endif // BCARENA_H
@@ -17,10 +17,14 @@
 #include <QStyleOptionGraphicsItem>
 #include <QPixmapCache>
 #include <QKeyEvent>
+#include <QTimer>
+#include <QApplication>
+#include <qmath.h>
 
 #include "bcboard.h"
 #include "bcglobal.h"
 #include "bctank.h"
+#include "bcboardstate.h"
 
 BCEnemyTank *createEnemyTank(BattleCity::TankType type, BCBoard *parent)
 {
@@ -42,21 +46,106 @@ BCEnemyTank *createEnemyTank(BattleCity::TankType type, BCBoard *parent)
     return tank;
 }
 
+static BattleCity::ObstacleType obstacleType(int type)
+{
+    switch (type) {
+    case BattleCity::BricksWall:
+    case BattleCity::ConcreteWall:
+    case BattleCity::Ice:
+    case BattleCity::Camouflage:
+    case BattleCity::Water:
+        return BattleCity::ObstacleType(type);
+    default:
+        break;
+    }
+    return BattleCity::Ground;
+}
+
+static BattleCity::TankType tankType(int type)
+{
+    switch (type) {
+    case BattleCity::Fast:
+    case BattleCity::Power:
+    case BattleCity::Armor:
+        return BattleCity::TankType(type);
+    default:
+        break;
+    }
+    return BattleCity::Basic;
+}
+
+static BCItem *createObstacle(BattleCity::ObstacleType type, BCBoard *parent)
+{
+    BCItem *obstacle = 0;
+    switch (type) {
+    case BattleCity::BricksWall:
+        obstacle = new BCBricks(parent);
+        break;
+    case BattleCity::ConcreteWall:
+        obstacle = new BCConcrete(parent);
+        break;
+    case BattleCity::Ice:
+        obstacle = new BCIce(parent);
+        break;
+    case BattleCity::Camouflage:
+        obstacle = new BCCamouflage(parent);
+        break;
+    case BattleCity::Water:
+        obstacle = new BCWater(parent);
+        break;
+    default:
+        obstacle = new BCGroud(parent);
+        break;
+    }
+    return obstacle;
+}
+
 BCBoard::BCBoard(QDeclarativeItem *parent) :
     QDeclarativeItem(parent),
     m_boardSize(13),
     m_cellSize(35.0),
+    m_world(new QDeclarativeItem(this)),
+    m_cells(0),
+    m_gridSize(0),
     m_gridVisible(false),
+    m_activeEnemies(0),
     m_falcon(0),
-    m_playerTank(0)
+    m_bonus(0),
+    m_freezeTick(0),
+    m_shovelTick(0),
+    m_random(1),
+    m_playersCount(1),
+    m_tickTimer(new QTimer(this)),
+    m_tick(0),
+    m_effects(0)
 {
     setFlag(QGraphicsItem::ItemHasNoContents, false);
     setFlag(QGraphicsItem::ItemIsFocusable, true);
     setClip(true);
     setFocus(true);
     setCursor(BattleCity::Ground);
+    m_world->setTransformOrigin(QDeclarativeItem::TopLeft);
+    m_world->setScale(unitScale());
+    m_effects = new BCEffects(this);
+
+    for (int i = 0; i < maxActiveEnemies; ++i)
+        m_enemyTanks[i] = 0;
+    for (int i = 0; i < maxPlayers; ++i)
+        m_players[i].controller = new BCController(this);
+    m_players[1].controller->clearKeyMapping();
+    m_players[1].controller->setKeyMapping(Qt::Key_W, BCController::MoveForward);
+    m_players[1].controller->setKeyMapping(Qt::Key_S, BCController::MoveBackward);
+    m_players[1].controller->setKeyMapping(Qt::Key_A, BCController::MoveLeft);
+    m_players[1].controller->setKeyMapping(Qt::Key_D, BCController::MoveRight);
+    m_players[1].controller->setKeyMapping(Qt::Key_F, BCController::Fire);
+    for (int i = 2; i < maxPlayers; ++i)
+        m_players[i].controller->clearKeyMapping();
 
     init();
+
+    m_tickTimer->setInterval(BattleCity::tickInterval);
+    connect(m_tickTimer, SIGNAL(timeout()), SLOT(tick()));
+    m_tickTimer->start();
 }
 
 void BCBoard::setBoardSize(int boardSize)
@@ -73,6 +162,7 @@ void BCBoard::setCellSize(qreal size)
     if (m_cellSize == size)
         return;
     m_cellSize = size;
+    m_world->setScale(unitScale());
     emit cellSizeChanged(m_cellSize);
     update();
 }
@@ -82,116 +172,274 @@ qreal BCBoard::obsticaleSize() const
     return m_cellSize / 2.0;
 }
 
-void BCBoard::init()
+QRectF BCBoard::mapFromUnits(const QRect &rect) const
+{
+    return m_world->mapRectToParent(QRectF(rect));
+}
+
+QList<QPoint> BCBoard::cellLine(const QPoint &from, const QPoint &to)
+{
+    QList<QPoint> cells;
+    const int columns = qAbs(to.x() - from.x());
+    const int rows = qAbs(to.y() - from.y());
+    const int columnStep = to.x() < from.x() ? -1 : 1;
+    const int rowStep = to.y() < from.y() ? -1 : 1;
+    int error = columns - rows;
+    QPoint cell = from;
+    for (;;) {
+        cells << cell;
+        if (cell == to)
+            break;
+        const int error2 = 2 * error;
+        if (error2 > -rows) {
+            error -= rows;
+            cell.rx() += columnStep;
+        }
+        if (error2 < columns) {
+            error += columns;
+            cell.ry() += rowStep;
+        }
+    }
+    return cells;
+}
+
+static QPoint cellPosition(qreal x, qreal y, qreal size)
 {
-    foreach (const QList<BCItem *> &cells, m_cells)
-        qDeleteAll(cells);
-    m_cells.clear();
+    return QPoint(qFloor(x / size), qFloor(y / size));
+}
 
-    qDeleteAll(m_enemyTanks);
-    m_enemyTanks.clear();
+QPoint BCBoard::cellAt(qreal x, qreal y) const
+{
+    const QPoint cell = cellPosition(x, y, obsticaleSize());
+    if (cell.x() < 0 || cell.x() >= m_gridSize || cell.y() < 0 || cell.y() >= m_gridSize)
+        return QPoint(-1, -1);
+    return cell;
+}
+
+QVariantList BCBoard::cellsBetween(qreal x1, qreal y1, qreal x2, qreal y2) const
+{
+    QVariantList result;
+    const qreal size = obsticaleSize();
+    foreach (const QPoint &cell, cellLine(cellPosition(x1, y1, size), cellPosition(x2, y2, size))) {
+        if (cell.x() >= 0 && cell.x() < m_gridSize && cell.y() >= 0 && cell.y() < m_gridSize)
+            result << cell;
+    }
+    return result;
+}
 
-    delete m_falcon;
-    delete m_playerTank;
+void BCBoard::init()
+{
+    // Level objects go back to the pools and the level arena holding the
+    // cell grid is rewound. The tile chunks are new per level: saved board
+    // states may still share the old ones. The lane maps keep their
+    // storage for a level of the same size.
+    for (int i = 0; i < m_gridSize * m_gridSize; ++i)
+        releaseObstacle(m_cells[i]);
+    m_levelArena.reset();
 
     const int size = m_boardSize * m_cellSize + 1;
     setImplicitWidth(size);
     setImplicitHeight(size);
-    for (int row = 0; row < m_boardSize * 2; ++row) {
-        QList<BCItem *> items;
-        for (int column = 0; column < m_boardSize * 2; ++column) {
-            BCGroud *cell = new BCGroud(this);
-            connect(this, SIGNAL(cellSizeChanged(qreal)), cell, SLOT(setSize(qreal)));
+
+    m_gridSize = cellsCount();
+    m_tiles.resize(m_gridSize);
+    m_blockingLanes.resize(m_gridSize);
+    m_destructibleLanes.resize(m_gridSize);
+    m_cells = m_levelArena.allocate<BCItem *>(m_gridSize * m_gridSize);
+    m_effects->setImplicitWidth(unitSize());
+    m_effects->setImplicitHeight(unitSize());
+    m_effects->clear();
+    for (int row = 0; row < m_gridSize; ++row) {
+        for (int column = 0; column < m_gridSize; ++column) {
+            BCItem *cell = acquireObstacle(BattleCity::Ground);
             cell->setPosition(row, column);
-            cell->setSize(obsticaleSize());
-            items << cell;
+            m_cells[row * m_gridSize + column] = cell;
         }
-        m_cells << items;
-    }
-
-    m_playerTank = new BCPlayerTank(this);
-    m_playerTank->setSize(m_cellSize);
-    m_playerTank->setPosition(12, 4);
-
-    m_falcon = new BCFalcon(this);
-    m_falcon->setSize(m_cellSize);
-    m_falcon->setPosition(12, 6);
-
-    QList<BattleCity::TankType> tanks;
-    tanks << BattleCity::Basic << BattleCity::Basic
-          << BattleCity::Fast << BattleCity::Fast
-          << BattleCity::Basic << BattleCity::Basic
-          << BattleCity::Power << BattleCity::Power
-          << BattleCity::Fast << BattleCity::Fast
-          << BattleCity::Power << BattleCity::Power
-          << BattleCity::Basic << BattleCity::Basic
-          << BattleCity::Fast << BattleCity::Fast
-          << BattleCity::Power << BattleCity::Power
-          << BattleCity::Armor << BattleCity::Armor;
-
-    for (quint8 i = 0; i < enemyTanksCount(); ++i) {
-        BCEnemyTank *tank = createEnemyTank(tanks[i], this);
-        tank->setSize(m_cellSize);
-        tank->hide();
-        if (i % 3 == 1) {
-            tank->setPosition(0, 6);
-        } else if (i % 3 == 2) {
-            tank->setPosition(0, 12);
-        }
-        m_enemyTanks << tank;
     }
 
-    m_enemyTanks[5]->setBonus(true);
-    m_enemyTanks[11]->setBonus(true);
-    m_enemyTanks[17]->setBonus(true);
+    m_projectiles.clear();
+    // A level starts like a new game: stars are gone, lives are back.
+    for (int i = 0; i < m_playersCount; ++i) {
+        resetPlayer(i);
+        m_players[i].tank->setLives(BCPlayerTank::defaultLives);
+    }
+
+    if (!m_falcon)
+        m_falcon = new BCFalcon(this);
+    const QPoint falcon = falconCell(m_boardSize);
+    m_falcon->setPosition(falcon.y(), falcon.x());
+    m_falcon->setDestroyed(false);
+
+    if (!m_bonus)
+        m_bonus = new BCBonus(this);
+    m_bonus->hide();
+    m_freezeTick = 0;
+    m_shovelTick = 0;
+    m_random = 1;
+
+    for (int i = 0; i < maxActiveEnemies; ++i)
+        releaseEnemySlot(i);
+    m_spawner.rewind();
 }
 
-BCItem *BCBoard::obstacle(int row, int column) const
+// Offsets from the falcon column: the classic 13 cell layout, moved along
+// with the falcon so that no spawn point lands on it or its wall.
+static const int playerSpawnOffsets[BCBoard::maxPlayers] = { -2, 2, -4, 4, -6, 6, -3, 3 };
+
+int BCBoard::playerSpawnColumn(int boardSize, int player)
+{
+    return falconCell(boardSize).x() + playerSpawnOffsets[player];
+}
+
+int BCBoard::enemySpawnColumn(int boardSize, int index)
+{
+    const int spawnColumns[enemySpawnPoints] = { 0, boardSize / 2, boardSize - 1 };
+    return spawnColumns[index % enemySpawnPoints];
+}
+
+void BCBoard::loadTiles(int boardSize, const QByteArray &tiles)
 {
-    if (row >= m_cells.count() || row < 0 || column < 0)
+    setBoardSize(boardSize);
+    init();
+    const int count = qMin(tiles.size(), m_gridSize * m_gridSize);
+    for (int i = 0; i < count; ++i)
+        setObstacleType(i / m_gridSize, i % m_gridSize, BattleCity::Ground + tiles.at(i));
+}
+
+void BCBoard::loadStage(const BCStage &stage)
+{
+    loadTiles(stage.boardSize, stage.tiles);
+    const int rosterCount = m_spawner.rosterCount();
+    m_spawner = stage.spawner;
+    m_spawner.rewind();
+    if (m_spawner.rosterCount() != rosterCount)
+        emit enemyTanksCountChanged();
+}
+
+// Durations of the timed power-ups, in ticks.
+static const quint32 spawnShieldTicks = 3000 / BattleCity::tickInterval;
+static const quint32 helmetTicks = 10000 / BattleCity::tickInterval;
+static const quint32 shovelTicks = 20000 / BattleCity::tickInterval;
+static const quint32 freezeTicks = 10000 / BattleCity::tickInterval;
+
+void BCBoard::resetPlayer(int player)
+{
+    Player &p = m_players[player];
+    if (!p.tank)
+        p.tank = new BCPlayerTank(this);
+    p.tank->reset();
+    p.tank->setPosition(m_boardSize - 1, playerSpawnColumn(m_boardSize, player));
+    p.tank->show();
+    p.input.clear();
+}
+
+void BCBoard::respawnPlayer(int player)
+{
+    BCPlayerTank *tank = m_players[player].tank;
+    tank->setLives(tank->lives() - 1);
+    resetPlayer(player);
+    tank->setShieldTick(m_tick + spawnShieldTicks);
+}
+
+void BCBoard::setPlayersCount(int count)
+{
+    count = qBound(1, count, int(maxPlayers));
+    if (m_playersCount == count)
+        return;
+    for (int i = count; i < m_playersCount; ++i) {
+        m_players[i].tank->reset();
+        m_players[i].tank->hide();
+    }
+    for (int i = m_playersCount; i < count; ++i)
+        resetPlayer(i);
+    m_playersCount = count;
+    emit playersCountChanged();
+}
+
+BCController *BCBoard::playerController(int player) const
+{
+    if (player < 0 || player >= maxPlayers)
         return 0;
-    const QList<BCItem *> &items = m_cells[row];
-    if (column >= items.count())
+    return m_players[player].controller;
+}
+
+BCPlayerTank *BCBoard::playerTank(int player) const
+{
+    if (player < 0 || player >= m_playersCount)
         return 0;
-    return items[column];
+    return m_players[player].tank;
 }
 
-static BCItem *createObstacle(BattleCity::ObstacleType type, BCBoard *parent)
+BCItem *BCBoard::acquireObstacle(BattleCity::ObstacleType type)
 {
-    BCItem *obstacle = 0;
-    switch (type) {
-    case BattleCity::BricksWall:
-        obstacle = new BCBricks(parent);
-        break;
-    case BattleCity::ConcreteWall:
-        obstacle = new BCConcrete(parent);
-        break;
-    case BattleCity::Ice:
-        obstacle = new BCIce(parent);
-        break;
-    case BattleCity::Camouflage:
-        obstacle = new BCCamouflage(parent);
-        break;
-    case BattleCity::Water:
-        obstacle = new BCWater(parent);
-        break;
-    default:
-        obstacle = new BCGroud(parent);
-        break;
+    QList<BCItem *> &pool = m_obstaclesPool[type - BattleCity::Ground];
+    if (!pool.isEmpty()) {
+        BCItem *obstacle = pool.takeLast();
+        obstacle->show();
+        return obstacle;
     }
-    return obstacle;
+    return ::createObstacle(type, this);
+}
+
+void BCBoard::releaseObstacle(BCItem *obstacle)
+{
+    obstacle->hide();
+    m_obstaclesPool[obstacle->type() - BattleCity::Ground].append(obstacle);
+}
+
+BCEnemyTank *BCBoard::acquireEnemyTank(BattleCity::TankType type)
+{
+    QList<BCEnemyTank *> &pool = m_enemyTanksPool[type - BattleCity::Basic];
+    if (!pool.isEmpty())
+        return pool.takeLast();
+    return ::createEnemyTank(type, this);
+}
+
+void BCBoard::releaseEnemyTank(BCEnemyTank *tank)
+{
+    tank->hide();
+    tank->reset();
+    m_enemyTanksPool[tank->type() - BattleCity::Basic].append(tank);
+}
+
+void BCBoard::releaseEnemySlot(int slot)
+{
+    BCEnemyTank *tank = m_enemyTanks[slot];
+    if (!tank)
+        return;
+    // Its projectiles are reused by the next tank taken from the pool.
+    for (int i = 0; i < m_projectiles.count();) {
+        if (m_projectiles[i]->owner() == tank)
+            m_projectiles.removeAt(i);
+        else
+            ++i;
+    }
+    releaseEnemyTank(tank);
+    m_enemyTanks[slot] = 0;
+    --m_activeEnemies;
+}
+
+BCItem *BCBoard::obstacle(int row, int column) const
+{
+    if (row >= m_gridSize || row < 0 || column >= m_gridSize || column < 0)
+        return 0;
+    return m_cells[row * m_gridSize + column];
 }
 
 void BCBoard::setObstacleType(int row, int column, int type)
 {
     BCItem *obstacle = this->obstacle(row, column);
+    type = ::obstacleType(type);
     if (!obstacle || obstacle->type() == type)
         return;
-    BCItem *newObstacle = ::createObstacle(BattleCity::ObstacleType(type), this);
+    BCItem *newObstacle = acquireObstacle(BattleCity::ObstacleType(type));
     newObstacle->setPosition(obstacle->row(), obstacle->column());
-    newObstacle->setSize(obstacle->size());
-    obstacle->deleteLater();
-    m_cells[row][column] = newObstacle;
+    releaseObstacle(obstacle);
+    m_cells[row * m_gridSize + column] = newObstacle;
+    m_tiles.set(row, column, quint8(type - BattleCity::Ground));
+    const quint8 terrain = this->terrain(row, column);
+    m_blockingLanes.set(row, column, terrain & BCTerrain::BlocksProjectiles);
+    m_destructibleLanes.set(row, column, terrain & BCTerrain::Destructible);
 }
 
 void BCBoard::setGridVisible(bool visible)
@@ -205,6 +453,9 @@ void BCBoard::setGridVisible(bool visible)
 
 void BCBoard::setCursor(int type)
 {
+    // Headless tools run boards in an application without a GUI.
+    if (QApplication::type() == QApplication::Tty)
+        return;
     QPixmap pixmap = BattleCity::cursorPixmap(BattleCity::ObstacleType(type));
     pixmap = pixmap.scaled(QSize(pixmap.width() * 2, pixmap.height() * 2));
     QDeclarativeItem::setCursor(QCursor(pixmap));
@@ -213,13 +464,18 @@ void BCBoard::setCursor(int type)
 QDataStream &operator << (QDataStream &out, const BCBoard &board)
 {
     out << board.m_boardSize;
-    foreach (const QList<BCItem *> &rows, board.m_cells) {
-        foreach (BCItem *obstacle, rows)
-            out << obstacle->type();
-    }
-    foreach (const BCEnemyTank *tank, board.m_enemyTanks)
-        out << tank->type() << tank->bonus();
-    return out;
+    for (int i = 0; i < board.m_gridSize * board.m_gridSize; ++i)
+        out << board.m_cells[i]->type();
+
+    const BCSpawnScheduler &spawner = board.m_spawner;
+    out << BCBoard::rosterMagic << spawner.rosterCount();
+    for (int i = 0; i < spawner.rosterCount(); ++i)
+        out << int(spawner.tankType(i)) << spawner.bonus(i);
+    const QList<BCSpawnScheduler::Wave> waves = spawner.waves();
+    out << waves.count();
+    foreach (const BCSpawnScheduler::Wave &wave, waves)
+        out << wave.count << wave.maxActive << wave.interval;
+    return out << spawner.endless();
 }
 
 QDataStream &operator >> (QDataStream &in, BCBoard &board)
@@ -233,29 +489,338 @@ QDataStream &operator >> (QDataStream &in, BCBoard &board)
             board.setObstacleType(row, colum, type);
         }
     }
-    for (int index = 0; index < board.enemyTanksCount(); ++index) {
-        int type = -1;
+
+    int marker = -1;
+    in >> marker;
+    const bool legacy = marker != BCBoard::rosterMagic;
+    int count = 20;
+    if (!legacy)
+        in >> count;
+    board.setEnemyTanksCount(count);
+    for (int index = 0; index < count; ++index) {
+        int type = legacy && index == 0 ? marker : -1;
         bool bonus = false;
-        in >> type >> bonus;
+        if (!legacy || index)
+            in >> type;
+        in >> bonus;
         board.setEnemyTankType(index, type, bonus);
     }
+
+    QList<BCSpawnScheduler::Wave> waves;
+    bool endless = false;
+    if (!legacy) {
+        int wavesCount = 0;
+        in >> wavesCount;
+        for (int i = 0; i < wavesCount && in.status() == QDataStream::Ok; ++i) {
+            BCSpawnScheduler::Wave wave;
+            in >> wave.count >> wave.maxActive >> wave.interval;
+            wave.maxActive = qMin(wave.maxActive, int(BCBoard::maxActiveEnemies));
+            waves << wave;
+        }
+        in >> endless;
+    }
+    board.m_spawner.setWaves(waves);
+    board.m_spawner.setEndless(endless);
     return in;
 }
 
-void BCBoard::keyPressEvent(QKeyEvent *event)   //TODO: must be in Controller
+void BCBoard::keyPressEvent(QKeyEvent *event)
+{
+    bool handled = false;
+    for (int i = 0; i < m_playersCount; ++i)
+        handled |= m_players[i].controller->handleKeyEvent(event);
+    if (!handled)
+        QDeclarativeItem::keyPressEvent(event);
+}
+
+void BCBoard::keyReleaseEvent(QKeyEvent *event)
+{
+    bool handled = false;
+    for (int i = 0; i < m_playersCount; ++i)
+        handled |= m_players[i].controller->handleKeyEvent(event);
+    if (!handled)
+        QDeclarativeItem::keyReleaseEvent(event);
+}
+
+void BCBoard::addProjectile(BCProjectile *projectile)
+{
+    // A projectile stopped and fired again before the step dropped it is
+    // still in the list.
+    if (!m_projectiles.contains(projectile))
+        m_projectiles.append(projectile);
+}
+
+void BCBoard::setAutoTick(bool autoTick)
+{
+    if (autoTick)
+        m_tickTimer->start();
+    else
+        m_tickTimer->stop();
+}
+
+bool BCBoard::autoTick() const
+{
+    return m_tickTimer->isActive();
+}
+
+void BCBoard::tick()
+{
+    BCInputFrame frames[maxPlayers];
+    BCInputCommand command;
+    for (int i = 0; i < m_playersCount; ++i) {
+        Player &player = m_players[i];
+        while (player.controller->takeCommand(&command))
+            player.input.apply(command);
+        frames[i] = player.input.frame();
+        player.input.clearPressed();
+    }
+    step(frames);
+}
+
+void BCBoard::step(const BCInputFrame *frames)
+{
+    ++m_tick;
+
+    updateEffects();
+
+    for (int i = 0; i < m_playersCount; ++i) {
+        BCPlayerTank *tank = m_players[i].tank;
+        if (tank->destroyed()) {
+            if (tank->lives())
+                respawnPlayer(i);
+            continue;
+        }
+        const int direction = BCInputState::frameDirection(frames[i]);
+        if (direction >= 0)
+            tank->move(BattleCity::MoveDirection(direction));
+        else
+            tank->slide();
+        if (BCInputState::isFrameActive(frames[i], BCController::Fire))
+            tank->fire();
+        takeBonus(i);
+    }
+
+    stepEnemies();
+
+    for (int i = 0; i < m_projectiles.count();) {
+        BCProjectile *projectile = m_projectiles[i];
+        if (projectile->isVisible() && projectile->step()) {
+            ++i;
+            continue;
+        }
+        if (projectile->isVisible())
+            projectileExploded(projectile);
+        m_projectiles[i] = m_projectiles.last();
+        m_projectiles.removeLast();
+    }
+
+    spawnEnemy();
+
+    m_animator.advance(m_tick);
+    m_effects->step();
+    emit stepped(m_tick);
+}
+
+int BCBoard::tankId(BCAbstractTank *tank) const
 {
-    BCAbstractTank *tank = /*m_enemyTanks.first();*/m_playerTank;
-    if (event->key() == Qt::Key_Up)
-        tank->move(BattleCity::Forward);
-    if (event->key() == Qt::Key_Down)
-        tank->move(BattleCity::Backward);
-    if (event->key() == Qt::Key_Left)
-        tank->move(BattleCity::Left);
-    if (event->key() == Qt::Key_Right)
-        tank->move(BattleCity::Right);
-    if (event->key() == Qt::Key_Space)
-        tank->fire();
+    for (int i = 0; i < m_playersCount; ++i) {
+        if (m_players[i].tank == tank)
+            return i;
+    }
+    for (int i = 0; i < maxActiveEnemies; ++i) {
+        if (m_enemyTanks[i] == tank)
+            return maxPlayers + i;
+    }
+    return -1;
+}
+
+BCAbstractTank *BCBoard::tankById(int id) const
+{
+    if (id < maxPlayers)
+        return playerTank(id);
+    return enemyTank(id - maxPlayers);
+}
+
+BCBoardState BCBoard::saveState() const
+{
+    BCBoardState state;
+    state.tick = m_tick;
+    state.tiles = m_tiles;
+    state.playersCount = m_playersCount;
+
+    state.tanks.resize(m_playersCount + maxActiveEnemies);
+    BCTankState *tankState = state.tanks.data();
+    for (int i = 0; i < m_playersCount; ++i)
+        m_players[i].tank->saveState(tankState++);
+    for (int i = 0; i < maxActiveEnemies; ++i, ++tankState) {
+        if (m_enemyTanks[i])
+            m_enemyTanks[i]->saveState(tankState);
+    }
+    state.spawner = m_spawner;
+
+    state.bonusType = m_bonus->isVisible() ? qint8(m_bonus->bonusType()) : qint8(-1);
+    state.bonusRow = quint8(m_bonus->row());
+    state.bonusColumn = quint8(m_bonus->column());
+    state.freezeTick = m_freezeTick;
+    state.shovelTick = m_shovelTick;
+    state.random = m_random;
+    state.falconDestroyed = m_falcon->destroyed();
+
+    state.projectiles.reserve(m_projectiles.count());
+    foreach (BCProjectile *projectile, m_projectiles) {
+        const int id = tankId(projectile->owner());
+        const int index = id < maxPlayers ? id : m_playersCount + id - maxPlayers;
+        state.projectiles << quint16(index << 8 | projectile->owner()->projectileIndex(projectile));
+    }
+    return state;
 }
+
+void BCBoard::restoreState(const BCBoardState &state)
+{
+    if (state.tiles.gridSize() != m_gridSize)
+        return;
+    m_tick = state.tick;
+
+    // Bands still shared with the current tiles did not change since the
+    // state was saved, only the others are compared cell by cell.
+    for (int chunk = 0; chunk < m_tiles.chunksCount(); ++chunk) {
+        if (m_tiles.sharesChunk(state.tiles, chunk))
+            continue;
+        const int lastRow = qMin(m_gridSize, (chunk + 1) * BCTileStore::ChunkRows);
+        for (int row = chunk * BCTileStore::ChunkRows; row < lastRow; ++row) {
+            for (int column = 0; column < m_gridSize; ++column) {
+                if (m_tiles.at(row, column) != state.tiles.at(row, column))
+                    setObstacleType(row, column, BattleCity::Ground + state.tiles.at(row, column));
+            }
+        }
+    }
+    m_tiles = state.tiles;
+
+    setPlayersCount(state.playersCount);
+    if (state.tanks.count() != m_playersCount + maxActiveEnemies)
+        return;
+    const BCTankState *tankState = state.tanks.constData();
+    for (int i = 0; i < m_playersCount; ++i)
+        m_players[i].tank->restoreState(*tankState++);
+    for (int i = 0; i < maxActiveEnemies; ++i, ++tankState) {
+        if (m_enemyTanks[i] && m_enemyTanks[i]->type() != tankState->type)
+            releaseEnemySlot(i);
+        if (!tankState->type)
+            continue;
+        if (!m_enemyTanks[i]) {
+            m_enemyTanks[i] = acquireEnemyTank(::tankType(tankState->type));
+            ++m_activeEnemies;
+        }
+        m_enemyTanks[i]->restoreState(*tankState);
+    }
+    m_spawner = state.spawner;
+
+    if (state.bonusType < 0) {
+        m_bonus->hide();
+    } else {
+        m_bonus->setBonusType(BattleCity::BonusType(state.bonusType));
+        m_bonus->setPosition(state.bonusRow, state.bonusColumn);
+        m_bonus->show();
+    }
+    m_freezeTick = state.freezeTick;
+    m_shovelTick = state.shovelTick;
+    m_random = state.random;
+    m_falcon->setDestroyed(state.falconDestroyed);
+
+    m_projectiles.clear();
+    foreach (quint16 projectile, state.projectiles) {
+        const int index = projectile >> 8;
+        BCAbstractTank *tank = tankById(index < m_playersCount ? index : maxPlayers + index - m_playersCount);
+        if (tank && tank->projectile(projectile & 0xff))
+            m_projectiles << tank->projectile(projectile & 0xff);
+    }
+}
+
+void BCBoard::saveCheckpoint()
+{
+    m_checkpoint = saveState();
+}
+
+void BCBoard::restoreCheckpoint()
+{
+    restoreState(m_checkpoint);
+}
+
+void BCBoard::projectileExploded(BCProjectile *projectile)
+{
+    projectile->stop();
+    m_effects->burst(BCEffects::ProjectileImpact, projectile->unitRect().center());
+
+    BCItem *target = projectile->target();
+    if (!target)
+        return;
+
+    switch (target->type()) {
+    case BattleCity::BricksWall:
+        setObstacleType(target->row(), target->column(), BattleCity::Ground);
+        break;
+    case BattleCity::ConcreteWall:
+        if (projectile->owner()->canDestroyConcrete())
+            setObstacleType(target->row(), target->column(), BattleCity::Ground);
+        break;
+    case BattleCity::Basic:
+    case BattleCity::Fast:
+    case BattleCity::Power:
+    case BattleCity::Armor:
+    case BattleCity::Player: {
+        // No friendly fire: enemies do not hit enemies, players do not hit players.
+        const bool playerShot = projectile->owner()->type() == BattleCity::Player;
+        if (playerShot == (target->type() == BattleCity::Player))
+            break;
+        if (!playerShot && static_cast<BCPlayerTank *>(target)->shielded())
+            break;
+        // A bonus tank drops its power-up on the first hit.
+        const bool bonus = playerShot && static_cast<BCEnemyTank *>(target)->bonus();
+        BCAbstractTank *tank = static_cast<BCAbstractTank *>(target);
+        tank->hit();
+        if (tank->destroyed()) {
+            tank->hide();
+            m_effects->burst(BCEffects::TankExplosion, tank->unitRect().center());
+        }
+        if (bonus)
+            spawnBonus();
+        break;
+    }
+    case BattleCity::Falcon:
+        m_falcon->setDestroyed(true);
+        m_effects->burst(BCEffects::FalconExplosion, m_falcon->unitRect().center());
+        break;
+    default:
+        break;
+    }
+}
+
+bool BCBoard::falconDestroyed() const
+{
+    return m_falcon->destroyed();
+}
+
+bool BCBoard::playersDefeated() const
+{
+    for (int i = 0; i < m_playersCount; ++i) {
+        const BCPlayerTank *tank = m_players[i].tank;
+        if (!tank->destroyed() || tank->lives())
+            return false;
+    }
+    return true;
+}
+
+bool BCBoard::enemiesDefeated() const
+{
+    if (m_spawner.remaining())
+        return false;
+    for (int i = 0; i < maxActiveEnemies; ++i) {
+        if (m_enemyTanks[i] && !m_enemyTanks[i]->destroyed())
+            return false;
+    }
+    return true;
+}
+
 #ifdef BC_DEBUG_RECT
 void BCBoard::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
@@ -263,26 +828,341 @@ void BCBoard::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, Q
 }
 #endif
 
-BCEnemyTank *BCBoard::enemyTank(int index) const
+BCEnemyTank *BCBoard::enemyTank(int slot) const
 {
-    if (index < 0 || index >= m_enemyTanks.count())
+    if (slot < 0 || slot >= maxActiveEnemies)
         return 0;
-    return m_enemyTanks[index];
+    return m_enemyTanks[slot];
+}
+
+void BCBoard::setEnemyTanksCount(int count)
+{
+    if (m_spawner.rosterCount() == count)
+        return;
+    m_spawner.setRosterCount(count);
+    emit enemyTanksCountChanged();
+}
+
+int BCBoard::enemyTankType(int index) const
+{
+    return m_spawner.tankType(index);
+}
+
+bool BCBoard::enemyTankBonus(int index) const
+{
+    return m_spawner.bonus(index);
 }
 
 void BCBoard::setEnemyTankType(int index, int type, bool bonus)
 {
-    BCEnemyTank *tank = enemyTank(index);
+    m_spawner.setEntry(index, ::tankType(type), bonus);
+}
+
+void BCBoard::stepEnemies()
+{
+    for (int i = 0; i < maxActiveEnemies; ++i) {
+        BCEnemyTank *tank = m_enemyTanks[i];
+        if (!tank)
+            continue;
+        if (tank->destroyed()) {
+            releaseEnemySlot(i);
+            continue;
+        }
+        if (enemiesFrozen())
+            continue;
+        // Drive on until blocked, then turn; everything derives from the
+        // tick so that every peer takes the same decisions.
+        // A tank stuck at a wall it can break stays and shoots it.
+        bool atWall = false;
+        if (!tank->move(tank->direction())) {
+            const BCItem *wall = nearestDestructible(tank);
+            atWall = wall && laneDistance(tank, m_destructibleLanes) == 0
+                    && (wall->type() != BattleCity::ConcreteWall || tank->canDestroyConcrete());
+            if (!atWall)
+                tank->move(BattleCity::MoveDirection((tank->direction() + 1 + (m_tick + i) % 3) % 4));
+        }
+
+        // Fire at whatever is in the lane: the falcon, a visible player, or
+        // that wall; otherwise now and then.
+        bool target = atWall || canHit(tank, m_falcon);
+        for (int p = 0; p < m_playersCount && !target; ++p) {
+            const BCPlayerTank *player = m_players[p].tank;
+            target = !player->destroyed() && !player->covered() && canHit(tank, player);
+        }
+        if (target || (m_tick + i * 7) % 32 == 0)
+            tank->fire();
+    }
+}
+
+void BCBoard::spawnEnemy()
+{
+    if (m_activeEnemies == maxActiveEnemies)
+        return;
+    const int index = m_spawner.next(m_tick, m_activeEnemies);
+    if (index < 0)
+        return;
+
+    const int column = enemySpawnColumn(m_boardSize, m_spawner.spawnedCount());
+    if (!spawnPointFree(column))
+        return;
+
+    int slot = 0;
+    while (m_enemyTanks[slot])
+        ++slot;
+    BCEnemyTank *tank = acquireEnemyTank(m_spawner.tankType(index));
+    tank->setPosition(0, column);
+    tank->setBonus(m_spawner.bonus(index));
+    tank->show();
+    m_enemyTanks[slot] = tank;
+    ++m_activeEnemies;
+    m_spawner.spawned(m_tick);
+}
+
+bool BCBoard::spawnPointFree(int column) const
+{
+    const QRect spawnRect(column * BattleCity::tankUnits, 0, BattleCity::tankUnits, BattleCity::tankUnits);
+    for (int i = 0; i < m_playersCount; ++i) {
+        const BCPlayerTank *tank = m_players[i].tank;
+        if (tank->isVisible() && spawnRect.intersects(tank->unitRect()))
+            return false;
+    }
+    for (int i = 0; i < maxActiveEnemies; ++i) {
+        const BCEnemyTank *tank = m_enemyTanks[i];
+        if (tank && spawnRect.intersects(tank->unitRect()))
+            return false;
+    }
+    return true;
+}
+
+quint8 BCBoard::terrain(const QRect &rect, bool all) const
+{
+    const int firstRow = qMax(0, BattleCity::unitsToCell(rect.y()));
+    const int lastRow = qMin(m_gridSize - 1, BattleCity::unitsToCell(rect.y() + rect.height() - 1));
+    const int firstColumn = qMax(0, BattleCity::unitsToCell(rect.x()));
+    const int lastColumn = qMin(m_gridSize - 1, BattleCity::unitsToCell(rect.x() + rect.width() - 1));
+    if (firstRow > lastRow || firstColumn > lastColumn)
+        return 0;
+
+    quint8 flags = all ? 0xff : 0;
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            if (all)
+                flags &= terrain(row, column);
+            else
+                flags |= terrain(row, column);
+        }
+    }
+    return flags;
+}
+
+BCItem *BCBoard::actor(int index) const
+{
+    if (index < m_playersCount)
+        return m_players[index].tank;
+    index -= m_playersCount;
+    if (index < maxActiveEnemies)
+        return m_enemyTanks[index];
+    index -= maxActiveEnemies;
+    if (index == 0)
+        return m_falcon;
+    return m_projectiles.value(index - 1);
+}
+
+// The cells a projectile fired by the tank right now would cross: one or
+// two lines of cells along its direction, starting at the tank front.
+struct FiringLane
+{
+    explicit FiringLane(const BCAbstractTank *tank);
+
+    bool vertical;
+    bool forward;
+    int first;
+    int lines[2];
+    int center;
+    int halfWidth;
+};
+
+FiringLane::FiringLane(const BCAbstractTank *tank)
+{
+    const QRect &rect = tank->unitRect();
+    const BattleCity::MoveDirection direction = tank->direction();
+    vertical = direction == BattleCity::Forward || direction == BattleCity::Backward;
+    forward = direction == BattleCity::Backward || direction == BattleCity::Right;
+    switch (direction) {
+    case BattleCity::Forward:
+        first = BattleCity::unitsToCell(rect.y() - 1);
+        break;
+    case BattleCity::Backward:
+        first = BattleCity::unitsToCell(rect.y() + rect.height());
+        break;
+    case BattleCity::Left:
+        first = BattleCity::unitsToCell(rect.x() - 1);
+        break;
+    case BattleCity::Right:
+        first = BattleCity::unitsToCell(rect.x() + rect.width());
+        break;
+    }
+    center = vertical ? rect.x() + rect.width() / 2 : rect.y() + rect.height() / 2;
+    halfWidth = rect.width() / 12;
+    lines[0] = BattleCity::unitsToCell(center - halfWidth);
+    lines[1] = BattleCity::unitsToCell(center + halfWidth - 1);
+}
+
+int BCBoard::laneDistance(const BCAbstractTank *tank, const BCLaneMap &lanes, int *row, int *column) const
+{
+    const FiringLane lane(tank);
+    int distance = -1;
+    for (int i = 0; i < 2; ++i) {
+        if (i && lane.lines[1] == lane.lines[0])
+            break;
+        const int found = lane.vertical ? lanes.nextInColumn(lane.lines[i], lane.first, lane.forward)
+                                        : lanes.nextInRow(lane.lines[i], lane.first, lane.forward);
+        if (found < 0)
+            continue;
+        const int d = qAbs(found - lane.first);
+        if (distance >= 0 && d >= distance)
+            continue;
+        distance = d;
+        if (row)
+            *row = lane.vertical ? found : lane.lines[i];
+        if (column)
+            *column = lane.vertical ? lane.lines[i] : found;
+    }
+    return distance;
+}
+
+bool BCBoard::canHit(const BCAbstractTank *tank, const BCItem *target) const
+{
+    if (!tank || !target || !target->isVisible())
+        return false;
+
+    const FiringLane lane(tank);
+    const QRect &tankRect = tank->unitRect();
+    const QRect &targetRect = target->unitRect();
+    const int targetRight = targetRect.x() + targetRect.width();
+    const int targetBottom = targetRect.y() + targetRect.height();
+
+    const int low = lane.vertical ? targetRect.x() : targetRect.y();
+    const int high = lane.vertical ? targetRight : targetBottom;
+    if (high <= lane.center - lane.halfWidth || low >= lane.center + lane.halfWidth)
+        return false;
+
+    const int targetCenterX = targetRect.x() + targetRect.width() / 2;
+    const int targetCenterY = targetRect.y() + targetRect.height() / 2;
+    int near = 0;
+    switch (tank->direction()) {
+    case BattleCity::Forward:
+        if (targetCenterY >= tankRect.y())
+            return false;
+        near = BattleCity::unitsToCell(targetBottom - 1);
+        break;
+    case BattleCity::Backward:
+        if (targetCenterY <= tankRect.y() + tankRect.height())
+            return false;
+        near = BattleCity::unitsToCell(targetRect.y());
+        break;
+    case BattleCity::Left:
+        if (targetCenterX >= tankRect.x())
+            return false;
+        near = BattleCity::unitsToCell(targetRight - 1);
+        break;
+    case BattleCity::Right:
+        if (targetCenterX <= tankRect.x() + tankRect.width())
+            return false;
+        near = BattleCity::unitsToCell(targetRect.x());
+        break;
+    }
+
+    const int targetDistance = qMax(0, lane.forward ? near - lane.first : lane.first - near);
+    const int blockerDistance = laneDistance(tank, m_blockingLanes);
+    return blockerDistance < 0 || blockerDistance > targetDistance;
+}
+
+BCItem *BCBoard::nearestDestructible(const BCAbstractTank *tank) const
+{
     if (!tank)
+        return 0;
+    int row = -1;
+    int column = -1;
+    // Destructible cells also block, so the nearest one is in front of any
+    // other blocker when both distances match.
+    const int distance = laneDistance(tank, m_destructibleLanes, &row, &column);
+    if (distance < 0 || distance != laneDistance(tank, m_blockingLanes))
+        return 0;
+    return obstacle(row, column);
+}
+
+quint32 BCBoard::random()
+{
+    // Plain LCG: it is part of the board state and must match on every peer.
+    m_random = m_random * 1103515245u + 12345u;
+    return m_random >> 16;
+}
+
+void BCBoard::spawnBonus()
+{
+    // Anywhere but the falcon row, like the original game.
+    m_bonus->setBonusType(BattleCity::BonusType(random() % (BattleCity::TankBonus + 1)));
+    m_bonus->setPosition(random() % (m_boardSize - 1), random() % m_boardSize);
+    m_bonus->show();
+}
+
+void BCBoard::takeBonus(int player)
+{
+    BCPlayerTank *tank = m_players[player].tank;
+    if (!m_bonus->isVisible())
         return;
-    if (tank->type() != type) {
-        BCEnemyTank *newTank = ::createEnemyTank(BattleCity::TankType(type), this);
-        newTank->setPosition(tank->row(), tank->column());
-        newTank->setSize(tank->size());
-        newTank->setVisible(tank->isVisible());
-        tank->deleteLater();
-        m_enemyTanks[index] = newTank;
-        tank = newTank;
-    }
-    tank->setBonus(bonus);
+    if (!m_bonus->unitRect().intersects(tank->unitRect()))
+        return;
+    m_bonus->hide();
+
+    switch (m_bonus->bonusType()) {
+    case BattleCity::StarBonus:
+        tank->upgrade();
+        break;
+    case BattleCity::GrenadeBonus:
+        for (int i = 0; i < maxActiveEnemies; ++i) {
+            BCEnemyTank *enemy = m_enemyTanks[i];
+            if (enemy && !enemy->destroyed()) {
+                enemy->destroy();
+                enemy->hide();
+            }
+        }
+        break;
+    case BattleCity::HelmetBonus:
+        tank->setShieldTick(m_tick + helmetTicks);
+        break;
+    case BattleCity::ShovelBonus:
+        fortifyFalcon(BattleCity::ConcreteWall);
+        m_shovelTick = m_tick + shovelTicks;
+        break;
+    case BattleCity::TimerBonus:
+        m_freezeTick = m_tick + freezeTicks;
+        break;
+    case BattleCity::TankBonus:
+        tank->setLives(tank->lives() + 1);
+        break;
+    }
+}
+
+void BCBoard::fortifyFalcon(BattleCity::ObstacleType type)
+{
+    // The ring of obstacle cells around the falcon, which takes 2x2 of them.
+    const int falconRow = m_falcon->row() * 2;
+    const int falconColumn = m_falcon->column() * 2;
+    for (int row = falconRow - 1; row <= falconRow + 2; ++row) {
+        for (int column = falconColumn - 1; column <= falconColumn + 2; ++column) {
+            const bool falcon = row >= falconRow && row <= falconRow + 1 && column >= falconColumn && column <= falconColumn + 1;
+            if (!falcon)
+                setObstacleType(row, column, type);
+        }
+    }
+}
+
+void BCBoard::updateEffects()
+{
+    if (m_shovelTick && m_tick >= m_shovelTick) {
+        fortifyFalcon(BattleCity::BricksWall);
+        m_shovelTick = 0;
+    }
 }
@@ -20,12 +20,38 @@
 #include <QDeclarativeItem>
 #include <QDataStream>
 
+#include "bcarena.h"
+#include "bcglobal.h"
+#include "bccontroller.h"
+#include "bcboardstate.h"
+#include "bcspawnscheduler.h"
+#include "bclanemap.h"
+#include "bcanimator.h"
+#include "bceffects.h"
+
 class BCBoard;
 class BCEnemyTank;
 //class BCObstacle;
 class BCItem;
 class BCFalcon;
+class BCBonus;
 class BCPlayerTank;
+class BCProjectile;
+class BCAbstractTank;
+class QTimer;
+
+// A level decoded away from the board (see BCMapValidator), ready to be
+// played by BCBoard::loadStage() without file access or parsing.
+struct BCStage
+{
+    BCStage() : boardSize(0) { }
+
+    bool isNull() const { return !boardSize; }
+
+    int boardSize;
+    QByteArray tiles;           // types relative to BattleCity::Ground, row by row
+    BCSpawnScheduler spawner;   // roster and waves
+};
 
 class BCBoard : public QDeclarativeItem
 {
@@ -38,7 +64,10 @@ class BCBoard : public QDeclarativeItem
     Q_PROPERTY(qreal cellSize READ cellSize WRITE setCellSize NOTIFY cellSizeChanged)
     Q_PROPERTY(qreal obsticaleSize READ obsticaleSize NOTIFY cellSizeChanged)
     Q_PROPERTY(bool gridVisible READ gridVisible WRITE setGridVisible NOTIFY gridVisibleChanged)
-    Q_PROPERTY(quint8 enemyTanksCount READ enemyTanksCount CONSTANT)
+    Q_PROPERTY(int enemyTanksCount READ enemyTanksCount WRITE setEnemyTanksCount NOTIFY enemyTanksCountChanged)
+    Q_PROPERTY(BCController *controller READ controller CONSTANT)
+    Q_PROPERTY(int playersCount READ playersCount WRITE setPlayersCount NOTIFY playersCountChanged)
+    Q_PROPERTY(BCEffects *effects READ effects CONSTANT)
 public:
     explicit BCBoard(QDeclarativeItem *parent = 0);
 
@@ -49,6 +78,31 @@ public:
     qreal cellSize() const { return m_cellSize; }
     qreal obsticaleSize() const;
 
+    // Board side in simulation units, and the screen length of one unit.
+    int unitSize() const { return m_gridSize * BattleCity::cellUnits; }
+    qreal unitScale() const { return m_cellSize / BattleCity::tankUnits; }
+
+    // Parent of every board item. Items are placed in simulation units and
+    // its transform maps them to the board, so a cell size change (resize,
+    // zoom) updates that one transform and no item geometry.
+    QDeclarativeItem *world() const { return m_world; }
+    QRectF mapFromUnits(const QRect &rect) const;
+
+    // Board cells (column, row) of the level layout for a board size: the
+    // falcon, the player and the enemy spawn points.
+    static QPoint falconCell(int boardSize) { return QPoint(boardSize / 2, boardSize - 1); }
+    static int playerSpawnColumn(int boardSize, int player);
+    static const int enemySpawnPoints = 3;
+    static int enemySpawnColumn(int boardSize, int index);
+
+    // Starts a level of the board size on the tiles, types relative to
+    // BattleCity::Ground row by row; the roster stays.
+    void loadTiles(int boardSize, const QByteArray &tiles);
+    void loadStage(const BCStage &stage);
+
+    // Obstacle cells from one cell to another, both included, in order.
+    static QList<QPoint> cellLine(const QPoint &from, const QPoint &to);
+
     void setGridVisible(bool visible);
     bool gridVisible() const { return m_gridVisible; }
 
@@ -57,37 +111,187 @@ public:
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
 #endif
 
-    static quint8 enemyTanksCount() { return 20; }
+    // The roster: every enemy of the level in spawn order.
+    void setEnemyTanksCount(int count);
+    int enemyTanksCount() const { return m_spawner.rosterCount(); }
+
+    BCSpawnScheduler *spawnScheduler() { return &m_spawner; }
+
+    // Enemies on the board are kept in fixed slots, empty slots are 0.
+    static const int maxActiveEnemies = 16;
+    int activeEnemiesCount() const { return m_activeEnemies; }
+
+    const BCTileStore &tiles() const { return m_tiles; }
+    quint8 terrain(int row, int column) const { return BCTerrain::flags(m_tiles.at(row, column)); }
+    // Terrain flags of the cells under the rect: of any of them, or
+    // only those shared by all of them.
+    quint8 terrain(const QRect &rect, bool all = false) const;
+
+    // Items, other than the tile grid, that block moves: tanks, the falcon
+    // and the projectiles in flight. Empty enemy slots are 0.
+    int actorsCount() const { return m_playersCount + maxActiveEnemies + 1 + m_projectiles.count(); }
+    BCItem *actor(int index) const;
+
+    // Firing lane queries, answered from the terrain only: other tanks in
+    // the way are not taken into account.
+    bool canHit(const BCAbstractTank *tank, const BCItem *target) const;
+    BCItem *nearestDestructible(const BCAbstractTank *tank) const;
+
+    static const int maxPlayers = 8;
+
+    // Maps of the first format end with a fixed roster of 20 (type, bonus)
+    // pairs; newer maps start the enemy section with this marker.
+    static const int rosterMagic = 0x42435257;
+
+    BCController *controller() const { return m_players[0].controller; }
+
+    void setPlayersCount(int count);
+    int playersCount() const { return m_playersCount; }
+
+    quint32 currentTick() const { return m_tick; }
+
+    // Item animations, advanced once per tick.
+    BCAnimator *animator() { return &m_animator; }
+    // Explosion particles, over the items.
+    BCEffects *effects() const { return m_effects; }
+
+    void setAutoTick(bool autoTick);
+    bool autoTick() const;
+
+    void step(const BCInputFrame *frames);
+
+    // Cloning a state is cheap: unchanged tile bands stay shared with the board.
+    BCBoardState saveState() const;
+    void restoreState(const BCBoardState &state);
+    quint32 stateHash() const { return saveState().hash(); }
+
+    void addProjectile(BCProjectile *projectile);
+
+    // The power-up waiting on the board, hidden when there is none.
+    BCBonus *bonus() const { return m_bonus; }
+    BCFalcon *falcon() const { return m_falcon; }
+    bool enemiesFrozen() const { return m_tick < m_freezeTick; }
+
+    // End of the level: the falcon is gone or no player has a tank or a
+    // life left (lost), or the whole roster was destroyed (won).
+    bool falconDestroyed() const;
+    bool playersDefeated() const;
+    bool enemiesDefeated() const;
+
+    // Seeds the board random generator (power-ups), init() resets it.
+    void setSeed(quint32 seed) { m_random = seed; }
 
 signals:
     void boardSizeChanged();
     void cellSizeChanged(qreal size);
     void gridVisibleChanged();
+    void playersCountChanged();
+    void enemyTanksCountChanged();
+    void stepped(quint32 tick);
 
 public slots:
     BCItem *obstacle(int row, int column) const;
     void setObstacleType(int row, int column, int type);
+    // Obstacle cell under a board position as (column, row), computed from
+    // the cell size; (-1, -1) off the grid.
+    QPoint cellAt(qreal x, qreal y) const;
+    // Cells on the segment between two board positions, off grid ones left out.
+    QVariantList cellsBetween(qreal x1, qreal y1, qreal x2, qreal y2) const;
     void setCursor(int type);
-    BCEnemyTank *enemyTank(int index) const;
+    BCEnemyTank *enemyTank(int slot) const;
+    int enemyTankType(int index) const;
+    bool enemyTankBonus(int index) const;
     void setEnemyTankType(int index, int type, bool bonus);
+    BCController *playerController(int player) const;
+    BCPlayerTank *playerTank(int player) const;
+
+    void saveCheckpoint();
+    void restoreCheckpoint();
+
+    void tick();
 
 protected:
     void keyPressEvent(QKeyEvent *event);
+    void keyReleaseEvent(QKeyEvent *event);
 
 private:
     void init();
 
+    int cellsCount() const { return m_boardSize * 2; }
+
+    BCItem *acquireObstacle(BattleCity::ObstacleType type);
+    void releaseObstacle(BCItem *obstacle);
+    BCEnemyTank *acquireEnemyTank(BattleCity::TankType type);
+    void releaseEnemyTank(BCEnemyTank *tank);
+    void releaseEnemySlot(int slot);
+
+    void stepEnemies();
+    void spawnEnemy();
+    bool spawnPointFree(int column) const;
+
+    void resetPlayer(int player);
+    void respawnPlayer(int player);
+    void projectileExploded(BCProjectile *projectile);
+
+    int laneDistance(const BCAbstractTank *tank, const BCLaneMap &lanes, int *row = 0, int *column = 0) const;
+
+    quint32 random();
+    void spawnBonus();
+    void takeBonus(int player);
+    void fortifyFalcon(BattleCity::ObstacleType type);
+    void updateEffects();
+
+    int tankId(BCAbstractTank *tank) const;
+    BCAbstractTank *tankById(int id) const;
+
 private:
+    struct Player
+    {
+        Player() : tank(0), controller(0) { }
+
+        BCPlayerTank *tank;
+        BCController *controller;
+        BCInputState input;
+    };
+
     int m_boardSize;
     qreal m_cellSize;
+    QDeclarativeItem *m_world;
 
-    mutable QList<QList<BCItem *> > m_cells;
+    // Holds the obstacle item grid of the level.
+    BCArena m_levelArena;
+    BCItem **m_cells;
+    int m_gridSize;
+    BCTileStore m_tiles;
+    BCLaneMap m_blockingLanes;
+    BCLaneMap m_destructibleLanes;
 
     bool m_gridVisible;
 
-    QList<BCEnemyTank *> m_enemyTanks;
+    BCEnemyTank *m_enemyTanks[maxActiveEnemies];
+    int m_activeEnemies;
+    BCSpawnScheduler m_spawner;
     BCFalcon *m_falcon;
-    BCPlayerTank *m_playerTank;
+
+    BCBonus *m_bonus;
+    quint32 m_freezeTick;
+    quint32 m_shovelTick;
+    quint32 m_random;
+
+    Player m_players[maxPlayers];
+    int m_playersCount;
+
+    QList<BCProjectile *> m_projectiles;
+
+    QTimer *m_tickTimer;
+    quint32 m_tick;
+    BCAnimator m_animator;
+    BCEffects *m_effects;
+
+    BCBoardState m_checkpoint;
+
+    QList<BCItem *> m_obstaclesPool[BattleCity::Water - BattleCity::Ground + 1];
+    QList<BCEnemyTank *> m_enemyTanksPool[BattleCity::Armor - BattleCity::Basic + 1];
 
 #ifdef BC_DEBUG_RECT
     QRectF m_debugRect;
@@ -0,0 +1,178 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "bcboardstate.h"
+
+const quint8 BCTerrain::table[BCTerrain::tilesCount] = {
+    0,                                  // Ground
+    BlocksTanks | BlocksProjectiles | Destructible,    // BricksWall
+    BlocksTanks | BlocksProjectiles | Destructible,    // ConcreteWall
+    Slippery,                           // Ice
+    Cover,                              // Camouflage
+    BlocksTanks | BlocksProjectiles,    // Falcon
+    BlocksTanks | BlocksProjectiles,    // FalconDestroyed
+    BlocksTanks                         // Water
+};
+
+void BCTileStore::resize(int gridSize)
+{
+    m_gridSize = gridSize;
+    m_chunks.clear();
+    for (int row = 0; row < gridSize; row += ChunkRows)
+        m_chunks << QByteArray(qMin(int(ChunkRows), gridSize - row) * gridSize, 0);
+}
+
+void BCTileStore::set(int row, int column, quint8 type)
+{
+    if (at(row, column) == type)
+        return;
+    m_chunks[row / ChunkRows].data()[(row % ChunkRows) * m_gridSize + column] = char(type);
+}
+
+// FNV-1a over the simulation relevant fields, stable across peers and builds.
+class Fnv
+{
+public:
+    Fnv() : m_hash(2166136261u) { }
+
+    void add(const char *data, int size)
+    {
+        for (int i = 0; i < size; ++i) {
+            m_hash ^= quint8(data[i]);
+            m_hash *= 16777619u;
+        }
+    }
+
+    // Integer fields go in least significant byte first, so that peers of
+    // any byte order agree.
+    template <typename T>
+    void add(T value)
+    {
+        const quint64 bits = quint64(value);
+        for (int i = 0; i < int(sizeof(T)); ++i) {
+            m_hash ^= quint8(bits >> (8 * i));
+            m_hash *= 16777619u;
+        }
+    }
+
+    quint32 hash() const { return m_hash; }
+
+private:
+    quint32 m_hash;
+};
+
+static void addMovable(Fnv &fnv, const BCMovableState &state)
+{
+    fnv.add(state.x);
+    fnv.add(state.y);
+    fnv.add(state.direction);
+    fnv.add(state.visible);
+}
+
+quint32 BCBoardState::hash() const
+{
+    Fnv fnv;
+    fnv.add(tick);
+    for (int i = 0; i < tiles.chunksCount(); ++i)
+        fnv.add(tiles.chunk(i).constData(), tiles.chunk(i).size());
+    fnv.add(playersCount);
+    foreach (const BCTankState &tank, tanks) {
+        addMovable(fnv, tank);
+        fnv.add(tank.type);
+        fnv.add(tank.destroyed);
+        fnv.add(tank.slideTicks);
+        fnv.add(tank.bonus);
+        fnv.add(tank.health);
+        fnv.add(tank.stars);
+        fnv.add(tank.lives);
+        fnv.add(tank.shieldTick);
+        fnv.add(tank.reloadTick);
+        fnv.add(tank.projectilesCount);
+        for (int i = 0; i < tank.projectilesCount; ++i) {
+            addMovable(fnv, tank.projectiles[i]);
+            fnv.add(tank.projectiles[i].speed);
+        }
+    }
+    foreach (quint16 projectile, projectiles)
+        fnv.add(projectile);
+    fnv.add(spawner.spawnedCount());
+    fnv.add(spawner.currentWave());
+    fnv.add(spawner.nextSpawnTick());
+    fnv.add(bonusType);
+    fnv.add(bonusRow);
+    fnv.add(bonusColumn);
+    fnv.add(freezeTick);
+    fnv.add(shovelTick);
+    fnv.add(random);
+    fnv.add(falconDestroyed);
+    return fnv.hash();
+}
+
+static QDataStream &operator << (QDataStream &out, const BCMovableState &state)
+{
+    return out << state.x << state.y << state.direction << state.visible;
+}
+
+static QDataStream &operator >> (QDataStream &in, BCMovableState &state)
+{
+    return in >> state.x >> state.y >> state.direction >> state.visible;
+}
+
+QDataStream &operator << (QDataStream &out, const BCBoardState &state)
+{
+    out << state.tick << state.tiles.gridSize();
+    for (int i = 0; i < state.tiles.chunksCount(); ++i)
+        out << state.tiles.chunk(i);
+    out << state.playersCount << quint16(state.tanks.count());
+    foreach (const BCTankState &tank, state.tanks) {
+        out << static_cast<const BCMovableState &>(tank) << tank.type << tank.animationStep << tank.destroyed << tank.slideTicks
+            << tank.bonus << tank.health << tank.stars << tank.lives << tank.shieldTick
+            << tank.reloadTick << tank.projectilesCount;
+        for (int i = 0; i < tank.projectilesCount; ++i)
+            out << static_cast<const BCMovableState &>(tank.projectiles[i]) << tank.projectiles[i].speed;
+    }
+    out << state.projectiles << state.spawner;
+    return out << state.bonusType << state.bonusRow << state.bonusColumn
+               << state.freezeTick << state.shovelTick << state.random << state.falconDestroyed;
+}
+
+QDataStream &operator >> (QDataStream &in, BCBoardState &state)
+{
+    int gridSize = 0;
+    in >> state.tick >> gridSize;
+    state.tiles.resize(gridSize);
+    for (int i = 0; i < state.tiles.chunksCount(); ++i) {
+        QByteArray chunk;
+        in >> chunk;
+        for (int j = 0; j < chunk.size() && j < state.tiles.chunk(i).size(); ++j)
+            state.tiles.set(i * BCTileStore::ChunkRows + j / gridSize, j % gridSize, quint8(chunk.at(j)));
+    }
+
+    quint16 count = 0;
+    in >> state.playersCount >> count;
+    state.tanks.resize(count);
+    for (int t = 0; t < count; ++t) {
+        BCTankState &tank = state.tanks[t];
+        in >> static_cast<BCMovableState &>(tank) >> tank.type >> tank.animationStep >> tank.destroyed >> tank.slideTicks
+           >> tank.bonus >> tank.health >> tank.stars >> tank.lives >> tank.shieldTick
+           >> tank.reloadTick >> tank.projectilesCount;
+        tank.projectilesCount = qMin(tank.projectilesCount, quint8(BCTankState::MaxProjectiles));
+        for (int i = 0; i < tank.projectilesCount; ++i)
+            in >> static_cast<BCMovableState &>(tank.projectiles[i]) >> tank.projectiles[i].speed;
+    }
+    in >> state.projectiles >> state.spawner;
+    return in >> state.bonusType >> state.bonusRow >> state.bonusColumn
+              >> state.freezeTick >> state.shovelTick >> state.random >> state.falconDestroyed;
+}
@@ -0,0 +1,142 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCBOARDSTATE_H
+#define BCBOARDSTATE_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QDataStream>
+
+#include "bcspawnscheduler.h"
+
+// Obstacle types of the tile grid (relative to BattleCity::Ground) split into
+// implicitly shared bands of rows. Copying a store is O(1), writing detaches
+// only the band that is touched, so states cloned from the same board share
+// every band that did not change.
+class BCTileStore
+{
+public:
+    enum { ChunkRows = 4 };
+
+    BCTileStore() : m_gridSize(0) { }
+
+    void resize(int gridSize);
+    int gridSize() const { return m_gridSize; }
+
+    quint8 at(int row, int column) const
+    { return m_chunks.at(row / ChunkRows).at((row % ChunkRows) * m_gridSize + column); }
+    void set(int row, int column, quint8 type);
+
+    int chunksCount() const { return m_chunks.count(); }
+    const QByteArray &chunk(int index) const { return m_chunks.at(index); }
+    bool sharesChunk(const BCTileStore &other, int index) const
+    { return m_chunks.at(index).constData() == other.m_chunks.at(index).constData(); }
+
+private:
+    int m_gridSize;
+    QVector<QByteArray> m_chunks;
+};
+
+// Movement rules of the tile types, indexed like the tile store (type
+// relative to BattleCity::Ground), so moving items never ask the cells.
+class BCTerrain
+{
+public:
+    enum Flag {
+        BlocksTanks = 0x01,
+        BlocksProjectiles = 0x02,
+        Slippery = 0x04,
+        Cover = 0x08,
+        Destructible = 0x10
+    };
+
+    static quint8 flags(quint8 tile) { return tile < tilesCount ? table[tile] : 0; }
+
+private:
+    enum { tilesCount = 8 };
+    static const quint8 table[tilesCount];
+};
+
+struct BCMovableState
+{
+    BCMovableState() : x(0), y(0), direction(0), visible(false) { }
+
+    qint32 x;           // simulation units
+    qint32 y;
+    quint8 direction;
+    bool visible;
+};
+
+struct BCProjectileState : BCMovableState
+{
+    BCProjectileState() : speed(0) { }
+
+    qint32 speed;
+};
+
+struct BCTankState : BCMovableState
+{
+    enum { MaxProjectiles = 2 };
+
+    BCTankState() :
+        type(0), animationStep(0), destroyed(false), slideTicks(0), bonus(false),
+        health(0), stars(0), lives(0), shieldTick(0), reloadTick(0), projectilesCount(0) { }
+
+    int type;
+    quint8 animationStep;
+    bool destroyed;
+    quint8 slideTicks;
+    bool bonus;
+    quint8 health;
+    quint8 stars;
+    quint8 lives;
+    quint32 shieldTick;
+    quint32 reloadTick;
+    quint8 projectilesCount;
+    BCProjectileState projectiles[MaxProjectiles];
+};
+
+// Live game state of a board: what BCBoard::saveState() captures and
+// BCBoard::restoreState() puts back.
+struct BCBoardState
+{
+    BCBoardState() :
+        tick(0), playersCount(0), bonusType(-1), bonusRow(0), bonusColumn(0),
+        freezeTick(0), shovelTick(0), random(0), falconDestroyed(false) { }
+
+    quint32 hash() const;
+
+    quint32 tick;
+    BCTileStore tiles;
+    int playersCount;
+    QVector<BCTankState> tanks;         // players first, then the enemy slots (type 0 when empty)
+    QVector<quint16> projectiles;       // in flight: tank index << 8 | projectile index
+    BCSpawnScheduler spawner;
+
+    qint8 bonusType;                    // power-up on the board, -1 when there is none
+    quint8 bonusRow;
+    quint8 bonusColumn;
+    quint32 freezeTick;                 // enemies stand still before the tick
+    quint32 shovelTick;                 // the falcon walls are concrete before the tick
+    quint32 random;
+    bool falconDestroyed;
+};
+
+QDataStream &operator << (QDataStream &out, const BCBoardState &state);
+QDataStream &operator >> (QDataStream &in, BCBoardState &state);
+
+#endif // BCBOARDSTATE_H
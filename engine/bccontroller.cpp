@@ -0,0 +1,140 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QKeyEvent>
+
+#include "bccontroller.h"
+
+static inline int loadAcquire(QAtomicInt &value)
+{
+#if QT_VERSION >= 0x050000
+    return value.loadAcquire();
+#else
+    return value.fetchAndAddAcquire(0);
+#endif
+}
+
+static inline void storeRelease(QAtomicInt &value, int newValue)
+{
+#if QT_VERSION >= 0x050000
+    value.storeRelease(newValue);
+#else
+    value.fetchAndStoreRelease(newValue);
+#endif
+}
+
+bool BCInputQueue::push(const BCInputCommand &command)
+{
+    const int tail = loadAcquire(m_tail);
+    const int next = (tail + 1) & (Capacity - 1);
+    if (next == loadAcquire(m_head))
+        return false;
+    m_commands[tail] = command;
+    storeRelease(m_tail, next);
+    return true;
+}
+
+bool BCInputQueue::pop(BCInputCommand *command)
+{
+    const int head = loadAcquire(m_head);
+    if (head == loadAcquire(m_tail))
+        return false;
+    *command = m_commands[head];
+    storeRelease(m_head, (head + 1) & (Capacity - 1));
+    return true;
+}
+
+void BCInputState::apply(const BCInputCommand &command)
+{
+    const quint8 bit = 1 << command.action;
+    if (command.pressed) {
+        held |= bit;
+        pressed |= bit;
+        if (command.action <= BCController::MoveRight)
+            direction = command.action;
+        return;
+    }
+
+    held &= ~bit;
+    if (direction != command.action)
+        return;
+    direction = -1;
+    for (int action = BCController::MoveForward; action <= BCController::MoveRight; ++action) {
+        if (held & (1 << action)) {
+            direction = action;
+            break;
+        }
+    }
+}
+
+BCController::BCController(QObject *parent) :
+    QObject(parent)
+{
+    setDefaultKeyMapping();
+}
+
+void BCController::setDefaultKeyMapping()
+{
+    m_keyMapping.insert(Qt::Key_Up, MoveForward);
+    m_keyMapping.insert(Qt::Key_Down, MoveBackward);
+    m_keyMapping.insert(Qt::Key_Left, MoveLeft);
+    m_keyMapping.insert(Qt::Key_Right, MoveRight);
+    m_keyMapping.insert(Qt::Key_Space, Fire);
+}
+
+BCController::~BCController()
+{
+    qDeleteAll(m_queues);
+}
+
+BCInputQueue *BCController::addQueue()
+{
+    BCInputQueue *queue = new BCInputQueue;
+    m_queues << queue;
+    return queue;
+}
+
+bool BCController::post(BCInputQueue *queue, Action action, bool pressed)
+{
+    if (action < MoveForward || action > Fire)
+        return false;
+
+    BCInputCommand command;
+    command.action = action;
+    command.pressed = pressed;
+    return queue->push(command);
+}
+
+bool BCController::takeCommand(BCInputCommand *command)
+{
+    if (m_queue.pop(command))
+        return true;
+    foreach (BCInputQueue *queue, m_queues) {
+        if (queue->pop(command))
+            return true;
+    }
+    return false;
+}
+
+bool BCController::handleKeyEvent(QKeyEvent *event)
+{
+    QHash<int, Action>::const_iterator it = m_keyMapping.constFind(event->key());
+    if (it == m_keyMapping.constEnd())
+        return false;
+    // Auto-repeat only re-sends the held state, the tick keeps acting on it.
+    if (!event->isAutoRepeat())
+        post(*it, event->type() == QEvent::KeyPress);
+    return true;
+}
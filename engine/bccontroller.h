@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCCONTROLLER_H
+#define BCCONTROLLER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+
+class QKeyEvent;
+
+// One tick of one player's input: active actions in the low five bits and
+// the move direction plus one in the high three bits.
+typedef quint8 BCInputFrame;
+
+struct BCInputCommand
+{
+    quint8 action;
+    bool pressed;
+};
+
+// Single-producer/single-consumer ring buffer. push() must only be called from
+// one thread and pop() from another (or the same) one; no locks are taken.
+class BCInputQueue
+{
+public:
+    enum { Capacity = 256 };
+
+    BCInputQueue() : m_head(0), m_tail(0) { }
+
+    bool push(const BCInputCommand &command);
+    bool pop(BCInputCommand *command);
+
+private:
+    Q_DISABLE_COPY(BCInputQueue)
+
+    BCInputCommand m_commands[Capacity];
+    QAtomicInt m_head;
+    QAtomicInt m_tail;
+};
+
+// Consumer side state of one input source, rebuilt by the simulation tick.
+struct BCInputState
+{
+    BCInputState() : held(0), pressed(0), direction(-1) { }
+
+    void apply(const BCInputCommand &command);
+    void clearPressed() { pressed = 0; }
+    void clear() { held = 0; pressed = 0; direction = -1; }
+
+    bool isActive(quint8 action) const { return (held | pressed) & (1 << action); }
+
+    BCInputFrame frame() const { return ((held | pressed) & 0x1f) | ((direction + 1) << 5); }
+    static int frameDirection(BCInputFrame frame) { return (frame >> 5) - 1; }
+    static bool isFrameActive(BCInputFrame frame, quint8 action) { return frame & (1 << action); }
+
+    quint8 held;
+    quint8 pressed;
+    qint8 direction;
+};
+
+class BCController : public QObject
+{
+    Q_OBJECT
+
+    Q_ENUMS(Action)
+public:
+    enum Action { MoveForward, MoveBackward, MoveLeft, MoveRight, Fire };
+
+    explicit BCController(QObject *parent = 0);
+    ~BCController();
+
+    // Key events, QML and post() share the queue of the controller thread.
+    // Unknown actions are dropped.
+    bool post(Action action, bool pressed) { return post(&m_queue, action, pressed); }
+
+    Q_INVOKABLE void press(int action) { post(Action(action), true); }
+    Q_INVOKABLE void release(int action) { post(Action(action), false); }
+
+    // Queue of another producer (replay, bot, network): only one thread,
+    // any one, posts to it. Queues are added before their producers start
+    // and belong to the controller.
+    BCInputQueue *addQueue();
+    static bool post(BCInputQueue *queue, Action action, bool pressed);
+
+    // Drains the controller queue, then the producer queues.
+    bool takeCommand(BCInputCommand *command);
+
+    void setKeyMapping(int key, Action action) { m_keyMapping.insert(key, action); }
+    void setDefaultKeyMapping();
+    void clearKeyMapping() { m_keyMapping.clear(); }
+    bool handleKeyEvent(QKeyEvent *event);
+
+private:
+    BCInputQueue m_queue;
+    QList<BCInputQueue *> m_queues;
+    QHash<int, Action> m_keyMapping;
+};
+
+#endif // BCCONTROLLER_H
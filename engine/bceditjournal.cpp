@@ -0,0 +1,247 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include "bceditjournal.h"
+#include "bcboard.h"
+#include "bcitem.h"
+
+BCEditJournal::BCEditJournal(QObject *parent) :
+    QObject(parent),
+    m_symmetry(NoSymmetry),
+    m_clipboardColumns(0),
+    m_current(0),
+    m_open(false)
+{
+}
+
+void BCEditJournal::setBoard(BCBoard *board)
+{
+    if (m_board == board)
+        return;
+    m_board = board;
+    clear();
+    emit boardChanged();
+}
+
+void BCEditJournal::beginStroke()
+{
+    endStroke();
+    truncate();
+    m_strokes << m_changes.count();
+    m_open = true;
+}
+
+void BCEditJournal::setSymmetry(Symmetries symmetry)
+{
+    if (m_symmetry == symmetry)
+        return;
+    m_symmetry = symmetry;
+    emit symmetryChanged();
+}
+
+int BCEditJournal::gridSize() const
+{
+    return m_board ? m_board->boardSize() * 2 : 0;
+}
+
+void BCEditJournal::paint(int row, int column, int type)
+{
+    const int last = gridSize() - 1;
+    set(row, column, type);
+    if (m_symmetry & MirrorColumns)
+        set(row, last - column, type);
+    if (m_symmetry & MirrorRows)
+        set(last - row, column, type);
+    if ((m_symmetry & MirrorColumns) && (m_symmetry & MirrorRows))
+        set(last - row, last - column, type);
+}
+
+void BCEditJournal::set(int row, int column, int type)
+{
+    if (!m_board)
+        return;
+    const BCItem *obstacle = m_board->obstacle(row, column);
+    if (!obstacle)
+        return;
+    const int from = obstacle->type();
+    m_board->setObstacleType(row, column, type);
+    const int to = m_board->obstacle(row, column)->type();
+    if (from == to)
+        return;
+
+    if (!m_open)
+        beginStroke();
+    Change change;
+    change.row = row;
+    change.column = column;
+    change.from = from - BattleCity::Ground;
+    change.to = to - BattleCity::Ground;
+    m_changes << change;
+}
+
+void BCEditJournal::endStroke()
+{
+    if (!m_open)
+        return;
+    m_open = false;
+    if (m_strokes.last() == m_changes.count())
+        m_strokes.pop_back();
+    else
+        m_current = m_strokes.count();
+    emit changed();
+}
+
+void BCEditJournal::paintLine(int fromRow, int fromColumn, int toRow, int toColumn, int type)
+{
+    const bool open = m_open;
+    if (!open)
+        beginStroke();
+    foreach (const QPoint &cell, BCBoard::cellLine(QPoint(fromColumn, fromRow), QPoint(toColumn, toRow)))
+        paint(cell.y(), cell.x(), type);
+    if (!open)
+        endStroke();
+}
+
+void BCEditJournal::fillRect(int row, int column, int rows, int columns, int type)
+{
+    const QRect rect = QRect(column, row, columns, rows).normalized() & QRect(0, 0, gridSize(), gridSize());
+    if (rect.isEmpty())
+        return;
+    const bool open = m_open;
+    if (!open)
+        beginStroke();
+    for (int r = rect.top(); r <= rect.bottom(); ++r) {
+        for (int c = rect.left(); c <= rect.right(); ++c)
+            paint(r, c, type);
+    }
+    if (!open)
+        endStroke();
+}
+
+void BCEditJournal::floodFill(int row, int column, int type)
+{
+    const int size = gridSize();
+    if (row < 0 || row >= size || column < 0 || column >= size)
+        return;
+    const BCTileStore &tiles = m_board->tiles();
+    const quint8 target = tiles.at(row, column);
+
+    // Collect the region first, painting changes the tiles it is made of.
+    QVector<bool> visited(size * size, false);
+    QVector<int> region;
+    QVector<int> pending;
+    pending << row * size + column;
+    visited[row * size + column] = true;
+    while (!pending.isEmpty()) {
+        const int cell = pending.last();
+        pending.pop_back();
+        region << cell;
+        const int r = cell / size;
+        const int c = cell % size;
+        const int neighbours[4][2] = { { r - 1, c }, { r + 1, c }, { r, c - 1 }, { r, c + 1 } };
+        for (int i = 0; i < 4; ++i) {
+            const int nr = neighbours[i][0];
+            const int nc = neighbours[i][1];
+            if (nr < 0 || nr >= size || nc < 0 || nc >= size || visited[nr * size + nc])
+                continue;
+            visited[nr * size + nc] = true;
+            if (tiles.at(nr, nc) == target)
+                pending << nr * size + nc;
+        }
+    }
+
+    const bool open = m_open;
+    if (!open)
+        beginStroke();
+    foreach (int cell, region)
+        paint(cell / size, cell % size, type);
+    if (!open)
+        endStroke();
+}
+
+void BCEditJournal::copy(int row, int column, int rows, int columns)
+{
+    const QRect rect = QRect(column, row, columns, rows).normalized() & QRect(0, 0, gridSize(), gridSize());
+    if (rect.isEmpty())
+        return;
+    const BCTileStore &tiles = m_board->tiles();
+    m_clipboard.resize(rect.width() * rect.height());
+    char *data = m_clipboard.data();
+    for (int r = rect.top(); r <= rect.bottom(); ++r) {
+        for (int c = rect.left(); c <= rect.right(); ++c)
+            *data++ = tiles.at(r, c);
+    }
+    m_clipboardColumns = rect.width();
+    emit clipboardChanged();
+}
+
+void BCEditJournal::paste(int row, int column)
+{
+    if (!hasClipboard())
+        return;
+    const bool open = m_open;
+    if (!open)
+        beginStroke();
+    const int rows = m_clipboard.size() / m_clipboardColumns;
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < m_clipboardColumns; ++c)
+            paint(row + r, column + c, BattleCity::Ground + m_clipboard.at(r * m_clipboardColumns + c));
+    }
+    if (!open)
+        endStroke();
+}
+
+void BCEditJournal::undo()
+{
+    endStroke();
+    if (!m_board || !canUndo())
+        return;
+    --m_current;
+    const int first = m_strokes[m_current];
+    for (int i = m_current + 1 < m_strokes.count() ? m_strokes[m_current + 1] : m_changes.count(); i-- > first; )
+        m_board->setObstacleType(m_changes[i].row, m_changes[i].column, BattleCity::Ground + m_changes[i].from);
+    emit changed();
+}
+
+void BCEditJournal::redo()
+{
+    endStroke();
+    if (!m_board || !canRedo())
+        return;
+    const int end = m_current + 1 < m_strokes.count() ? m_strokes[m_current + 1] : m_changes.count();
+    for (int i = m_strokes[m_current]; i < end; ++i)
+        m_board->setObstacleType(m_changes[i].row, m_changes[i].column, BattleCity::Ground + m_changes[i].to);
+    ++m_current;
+    emit changed();
+}
+
+void BCEditJournal::clear()
+{
+    m_changes.clear();
+    m_strokes.clear();
+    m_current = 0;
+    m_open = false;
+    emit changed();
+}
+
+// A new stroke drops the strokes that were undone.
+void BCEditJournal::truncate()
+{
+    if (m_current == m_strokes.count())
+        return;
+    m_changes.resize(m_strokes[m_current]);
+    m_strokes.resize(m_current);
+}
@@ -0,0 +1,118 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+
+#ifndef BCEDITJOURNAL_H
+#define BCEDITJOURNAL_H
+
+#include <QObject>
+#include <QVector>
+#include <QPointer>
+#include <QByteArray>
+
+class BCBoard;
+
+// Undo history of the map editor. A stroke (press, drag, release) is one
+// step; it is stored as the run of cells it changed, with their type before
+// and after, so the journal grows with the edits and never copies the board.
+// Region operations are strokes of their own, or part of the open one.
+class BCEditJournal : public QObject
+{
+    Q_OBJECT
+
+    Q_ENUMS(Symmetry)
+    Q_FLAGS(Symmetries)
+
+    Q_PROPERTY(BCBoard *board READ board WRITE setBoard NOTIFY boardChanged)
+    Q_PROPERTY(bool canUndo READ canUndo NOTIFY changed)
+    Q_PROPERTY(bool canRedo READ canRedo NOTIFY changed)
+    Q_PROPERTY(Symmetries symmetry READ symmetry WRITE setSymmetry NOTIFY symmetryChanged)
+    Q_PROPERTY(bool hasClipboard READ hasClipboard NOTIFY clipboardChanged)
+public:
+    // Every painted cell is mirrored across the vertical (left-right) and/or
+    // the horizontal (top-bottom) axis of the board.
+    enum Symmetry { NoSymmetry = 0x0, MirrorColumns = 0x1, MirrorRows = 0x2 };
+    Q_DECLARE_FLAGS(Symmetries, Symmetry)
+
+    explicit BCEditJournal(QObject *parent = 0);
+
+    BCBoard *board() const { return m_board; }
+    void setBoard(BCBoard *board);
+
+    Symmetries symmetry() const { return m_symmetry; }
+    void setSymmetry(Symmetries symmetry);
+
+    bool hasClipboard() const { return m_clipboardColumns > 0; }
+
+    bool canUndo() const { return m_current > 0; }
+    bool canRedo() const { return m_current < m_strokes.count(); }
+
+    int strokesCount() const { return m_strokes.count(); }
+    int changesCount() const { return m_changes.count(); }
+
+signals:
+    void boardChanged();
+    void changed();
+    void symmetryChanged();
+    void clipboardChanged();
+
+public slots:
+    void beginStroke();
+    // Sets the obstacle through the board and records it in the open stroke.
+    void paint(int row, int column, int type);
+    void endStroke();
+
+    // Cells between two cells, both included: drags paint whole lines
+    // however far the mouse moved between two events.
+    void paintLine(int fromRow, int fromColumn, int toRow, int toColumn, int type);
+    void fillRect(int row, int column, int rows, int columns, int type);
+    // The cells of the cell's type connected to it by their sides.
+    void floodFill(int row, int column, int type);
+
+    void copy(int row, int column, int rows, int columns);
+    void paste(int row, int column);
+
+    void undo();
+    void redo();
+    void clear();
+
+private:
+    struct Change
+    {
+        quint16 row;
+        quint16 column;
+        quint8 from;    // obstacle types relative to BattleCity::Ground
+        quint8 to;
+    };
+
+    void truncate();
+    void set(int row, int column, int type);
+    int gridSize() const;
+
+private:
+    QPointer<BCBoard> m_board;
+    Symmetries m_symmetry;
+    QByteArray m_clipboard;     // tile types, row by row
+    int m_clipboardColumns;
+    QVector<Change> m_changes;
+    QVector<int> m_strokes;     // index of the first change of every stroke
+    int m_current;              // strokes applied, the rest can be redone
+    bool m_open;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(BCEditJournal::Symmetries)
+
+#endif // BCEDITJOURNAL_H
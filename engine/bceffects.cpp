@@ -0,0 +1,131 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QPainter>
+#include <climits>
+
+#include "bceffects.h"
+#include "bcboard.h"
+
+const BCEffects::Definition BCEffects::definitions[EffectsCount] = {
+    {  6, 24,  8, 0, 3 },   // ProjectileImpact
+    { 24, 40, 20, 1, 4 },   // TankExplosion
+    { 64, 56, 40, 1, 5 }    // FalconExplosion
+};
+
+static const QRgb palette[] = { 0xffffffff, 0xffffff80, 0xffffb000, 0xffe04000, 0xff901000, 0xff808080 };
+static const int paletteSize = sizeof(palette) / sizeof(palette[0]);
+
+static const int particleSize = BattleCity::tankUnits / 16;
+
+BCEffects::BCEffects(BCBoard *board) :
+    QDeclarativeItem(board->world()),
+    m_particles(defaultBudget),
+    m_count(0),
+    m_budget(defaultBudget),
+    m_random(1)
+{
+    setFlag(ItemHasNoContents, false);
+    setZValue(4);
+}
+
+void BCEffects::setBudget(int budget)
+{
+    budget = qMax(0, budget);
+    if (m_budget == budget)
+        return;
+    m_budget = budget;
+    m_particles.resize(budget);
+    m_count = qMin(m_count, budget);
+    update();
+    emit budgetChanged();
+}
+
+quint32 BCEffects::random()
+{
+    m_random = m_random * 1103515245 + 12345;
+    return m_random >> 16;
+}
+
+void BCEffects::burst(Effect effect, const QPoint &center)
+{
+    const Definition &definition = definitions[effect];
+    const int count = qMin(int(definition.particles), m_budget - m_count);
+    const int range = 2 * definition.speed + 1;
+    for (int i = 0; i < count; ++i) {
+        Particle &particle = m_particles[m_count++];
+        particle.x = center.x();
+        particle.y = center.y();
+        particle.dx = int(random() % range) - definition.speed;
+        particle.dy = int(random() % range) - definition.speed;
+        particle.life = definition.life / 2 + random() % (definition.life / 2 + 1);
+        particle.color = definition.firstColor + random() % definition.colorsCount;
+    }
+}
+
+void BCEffects::clear()
+{
+    m_count = 0;
+    update();
+}
+
+void BCEffects::step()
+{
+    if (!m_count && m_dirty.isNull())
+        return;
+
+    // The area painted last time and the one painted next are repainted.
+    QRect dirty = m_dirty;
+    int left = INT_MAX, top = INT_MAX, right = INT_MIN, bottom = INT_MIN;
+    for (int i = 0; i < m_count;) {
+        Particle &particle = m_particles[i];
+        if (!--particle.life) {
+            particle = m_particles[--m_count];
+            continue;
+        }
+        particle.x += particle.dx;
+        particle.y += particle.dy;
+        left = qMin(left, particle.x);
+        top = qMin(top, particle.y);
+        right = qMax(right, particle.x);
+        bottom = qMax(bottom, particle.y);
+        ++i;
+    }
+    m_dirty = m_count ? QRect(QPoint(left, top), QPoint(right + particleSize, bottom + particleSize)) : QRect();
+    dirty |= m_dirty;
+    update(dirty);
+}
+
+void BCEffects::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(option);
+    Q_UNUSED(widget);
+    if (!m_count)
+        return;
+
+    QVector<QRect> rects[paletteSize];
+    for (int i = 0; i < m_count; ++i) {
+        const Particle &particle = m_particles.at(i);
+        rects[particle.color] << QRect(particle.x, particle.y, particleSize, particleSize);
+    }
+    painter->setPen(Qt::NoPen);
+    for (int i = 0; i < paletteSize; ++i) {
+        if (rects[i].isEmpty())
+            continue;
+        painter->setBrush(QColor::fromRgba(palette[i]));
+        painter->drawRects(rects[i]);
+    }
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCEFFECTS_H
+#define BCEFFECTS_H
+
+#include <QDeclarativeItem>
+#include <QVector>
+
+class BCBoard;
+
+// Explosion particles of a board. They live in a pool of a fixed capacity,
+// the budget, so the cost of a tick and of a paint is bounded however many
+// projectiles explode at once: a burst takes the free particles and the
+// rest of it is dropped. One item, over all the others in the board world,
+// paints every particle with one draw call per colour. Particles are looks
+// only: they are not part of the board state.
+class BCEffects : public QDeclarativeItem
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int budget READ budget WRITE setBudget NOTIFY budgetChanged)
+public:
+    enum Effect {
+        ProjectileImpact,
+        TankExplosion,
+        FalconExplosion,
+        EffectsCount
+    };
+
+    struct Definition
+    {
+        quint8 particles;
+        quint8 speed;       // most units a tick along each axis
+        quint8 life;        // most ticks
+        quint8 firstColor;  // palette entries the particles pick from
+        quint8 colorsCount;
+    };
+
+    static const Definition definitions[EffectsCount];
+    static const int defaultBudget = 256;
+
+    explicit BCEffects(BCBoard *board);
+
+    int budget() const { return m_budget; }
+    void setBudget(int budget);
+
+    int activeCount() const { return m_count; }
+
+    // A burst of the effect around a point in simulation units.
+    void burst(Effect effect, const QPoint &center);
+    void clear();
+
+    void step();
+
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+
+signals:
+    void budgetChanged();
+
+private:
+    quint32 random();
+
+    struct Particle
+    {
+        qint32 x;
+        qint32 y;
+        qint16 dx;
+        qint16 dy;
+        quint8 life;
+        quint8 color;
+    };
+
+    QVector<Particle> m_particles;
+    int m_count;
+    int m_budget;
+    quint32 m_random;
+    QRect m_dirty;
+};
+
+#endif // BCEFFECTS_H
@@ -0,0 +1,203 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QPainter>
+
+#include "bcframeexporter.h"
+#include "bctextureatlas.h"
+#include "bcglobal.h"
+#include "bcboard.h"
+
+BCFrameExporter::BCFrameExporter(QObject *parent) :
+    QObject(parent),
+    m_tileSize(BCTextureAtlas::slotSize),
+    m_interval(1),
+    m_format(PngSequence),
+    m_framesCount(0)
+{
+
+}
+
+void BCFrameExporter::setTileSize(int size)
+{
+    m_tileSize = qMax(1, size);
+    m_rendered = BCSnapshot();
+}
+
+bool BCFrameExporter::open(const QString &path, Format format)
+{
+    close();
+    m_format = format;
+    m_framesCount = 0;
+    if (format == PngSequence) {
+        m_dir = QDir(path);
+        return m_dir.mkpath(".");
+    }
+    if (path == "-")
+        return m_file.open(stdout, QIODevice::WriteOnly);
+    m_file.setFileName(path);
+    return m_file.open(QIODevice::WriteOnly);
+}
+
+void BCFrameExporter::close()
+{
+    if (m_file.isOpen())
+        m_file.close();
+}
+
+void BCFrameExporter::setBoard(BCBoard *board)
+{
+    if (m_board)
+        disconnect(m_board, 0, this, 0);
+    m_board = board;
+    if (!board)
+        return;
+    connect(board, SIGNAL(stepped(quint32)), SLOT(boardStepped(quint32)));
+    writeFrame(BCSnapshot::capture(board));
+}
+
+void BCFrameExporter::boardStepped(quint32 tick)
+{
+    if (m_board && tick % m_interval == 0)
+        writeFrame(BCSnapshot::capture(m_board));
+}
+
+const QImage &BCFrameExporter::render(const BCSnapshot &snapshot)
+{
+    const QImage &atlas = BCTextureAtlas::image();
+    const int gridSize = snapshot.gridSize;
+    const int tilesCount = gridSize * gridSize;
+    if (!gridSize)
+        return m_frame;
+
+    // 4:2:0 video wants even sizes, the odd line stays black.
+    const int size = (gridSize * m_tileSize + 1) & ~1;
+    const bool allTiles = m_tiles.width() != size || m_rendered.tiles.size() != tilesCount;
+    if (allTiles) {
+        m_tiles = QImage(size, size, QImage::Format_RGB32);
+        m_tiles.fill(0);
+    }
+
+    QPainter tiles(&m_tiles);
+    bool tilesChanged = allTiles;
+    for (int i = 0; i < tilesCount; ++i) {
+        const char tile = snapshot.tiles.at(i);
+        if (!allTiles && m_rendered.tiles.at(i) == tile)
+            continue;
+        const bool camouflage = BattleCity::Ground + tile == BattleCity::Camouflage;
+        const int slot = camouflage ? 0 : BCTextureAtlas::tileSlot(tile);
+        tiles.drawImage(QRect(i % gridSize * m_tileSize, i / gridSize * m_tileSize, m_tileSize, m_tileSize),
+                        atlas, BCTextureAtlas::slotRect(slot));
+        tilesChanged = true;
+    }
+    tiles.end();
+
+    if (tilesChanged) {
+        m_cover.clear();
+        for (int i = 0; i < tilesCount; ++i) {
+            if (BattleCity::Ground + snapshot.tiles.at(i) == BattleCity::Camouflage)
+                m_cover << i;
+        }
+    }
+
+    m_frame = m_tiles;
+    QPainter painter(&m_frame);
+    const qreal cellSize = 2 * m_tileSize;
+    const qreal unit = cellSize / BCSnapshot::positionScale;
+    foreach (const BCSnapshot::Actor &actor, snapshot.actors) {
+        const int slot = BCTextureAtlas::actorSlot(actor);
+        if (slot < 0)
+            continue;
+        const qreal size = actor.type == BCSnapshot::projectileType ? cellSize / 6 : cellSize;
+        painter.drawImage(QRectF(actor.x * unit, actor.y * unit, size, size), atlas, BCTextureAtlas::slotRect(slot));
+    }
+
+    // Camouflage goes over the tanks.
+    const QRect camouflage = BCTextureAtlas::slotRect(BattleCity::Camouflage - BattleCity::Ground);
+    foreach (int i, m_cover)
+        painter.drawImage(QRect(i % gridSize * m_tileSize, i / gridSize * m_tileSize, m_tileSize, m_tileSize), atlas, camouflage);
+    painter.end();
+
+    m_rendered = snapshot;
+    return m_frame;
+}
+
+bool BCFrameExporter::writeFrame(const BCSnapshot &snapshot)
+{
+    render(snapshot);
+    bool written;
+    if (m_format == PngSequence) {
+        written = m_frame.save(m_dir.filePath(QString("frame-%1.png").arg(m_framesCount, 6, 10, QLatin1Char('0'))), "PNG");
+    } else {
+        if (!m_file.isOpen())
+            return false;
+        if (m_framesCount == 0) {
+            // 1000 / (tickInterval * interval) frames a second, square pixels.
+            m_file.write(QString("YUV4MPEG2 W%1 H%2 F1000:%3 Ip A1:1 C420jpeg\n")
+                         .arg(m_frame.width()).arg(m_frame.height())
+                         .arg(BattleCity::tickInterval * m_interval).toLatin1());
+        }
+        writeY4mFrame();
+        written = m_file.error() == QFile::NoError;
+    }
+    if (written)
+        ++m_framesCount;
+    return written;
+}
+
+// Full range BT.601 (JPEG) planes, chroma averaged over 2x2 pixels.
+void BCFrameExporter::writeY4mFrame()
+{
+    const int width = m_frame.width();
+    const int height = m_frame.height();
+    const int lumaSize = width * height;
+    const int chromaSize = lumaSize / 4;
+    m_yuv.resize(lumaSize + 2 * chromaSize);
+    uchar *y = reinterpret_cast<uchar *>(m_yuv.data());
+    uchar *u = y + lumaSize;
+    uchar *v = u + chromaSize;
+
+    for (int row = 0; row < height; row += 2) {
+        const QRgb *line0 = reinterpret_cast<const QRgb *>(m_frame.constScanLine(row));
+        const QRgb *line1 = reinterpret_cast<const QRgb *>(m_frame.constScanLine(row + 1));
+        uchar *y0 = y + row * width;
+        uchar *y1 = y0 + width;
+        for (int column = 0; column < width; column += 2) {
+            int r = 0;
+            int g = 0;
+            int b = 0;
+            const QRgb pixels[] = { line0[column], line0[column + 1], line1[column], line1[column + 1] };
+            uchar *luma[] = { y0 + column, y0 + column + 1, y1 + column, y1 + column + 1 };
+            for (int i = 0; i < 4; ++i) {
+                const int pr = qRed(pixels[i]);
+                const int pg = qGreen(pixels[i]);
+                const int pb = qBlue(pixels[i]);
+                *luma[i] = (77 * pr + 150 * pg + 29 * pb + 128) >> 8;
+                r += pr;
+                g += pg;
+                b += pb;
+            }
+            r = (r + 2) >> 2;
+            g = (g + 2) >> 2;
+            b = (b + 2) >> 2;
+            *u++ = qBound(0, ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128, 255);
+            *v++ = qBound(0, ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128, 255);
+        }
+    }
+
+    m_file.write("FRAME\n", 6);
+    m_file.write(m_yuv);
+}
@@ -0,0 +1,88 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+
+#ifndef BCFRAMEEXPORTER_H
+#define BCFRAMEEXPORTER_H
+
+#include <QObject>
+#include <QImage>
+#include <QDir>
+#include <QFile>
+#include <QPointer>
+
+#include "bcsnapshot.h"
+
+class BCBoard;
+
+// Draws board snapshots in software into a framebuffer image, with no window
+// or scene, and streams the frames to disk: a PNG sequence or a YUV4MPEG2
+// stream, which may as well be a pipe to an encoder. The tile layer is kept
+// between frames and only the tiles that changed are drawn again.
+class BCFrameExporter : public QObject
+{
+    Q_OBJECT
+public:
+    enum Format { PngSequence, Y4m };
+
+    explicit BCFrameExporter(QObject *parent = 0);
+
+    // Pixels of an obstacle cell, the atlas texture size by default.
+    void setTileSize(int size);
+    int tileSize() const { return m_tileSize; }
+
+    // A frame every interval board ticks; also sets the Y4M frame rate.
+    void setInterval(int ticks) { m_interval = qMax(1, ticks); }
+    int interval() const { return m_interval; }
+
+    // Frames go to path/frame-000000.png, or to the Y4M file at path
+    // ("-" for the standard output).
+    bool open(const QString &path, Format format);
+    void close();
+
+    int framesCount() const { return m_framesCount; }
+
+    // Writes the current frame and then every interval-th tick of the board.
+    void setBoard(BCBoard *board);
+
+    const QImage &render(const BCSnapshot &snapshot);
+
+public slots:
+    bool writeFrame(const BCSnapshot &snapshot);
+
+private slots:
+    void boardStepped(quint32 tick);
+
+private:
+    void writeY4mFrame();
+
+private:
+    QPointer<BCBoard> m_board;
+    int m_tileSize;
+    int m_interval;
+    Format m_format;
+    QDir m_dir;
+    QFile m_file;
+    int m_framesCount;
+
+    QImage m_tiles;
+    QImage m_frame;
+    QVector<int> m_cover;
+    BCSnapshot m_rendered;
+    QByteArray m_yuv;
+};
+
+#endif // BCFRAMEEXPORTER_H
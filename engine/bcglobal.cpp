@@ -13,7 +13,11 @@
 **
 ****************************************************************************/
 
-#include <QPixmapCache>
+#include <QVector>
+#include <QResource>
+#include <QBuffer>
+#include <QDataStream>
+#include <QtConcurrentMap>
 #include <QPainter>
 #include <QStyleOptionGraphicsItem>
 
@@ -22,275 +26,229 @@
 #include "bctank.h"
 #include "bcmapsmanager.h"
 #include "bcboard.h"
+#include "bccontroller.h"
+#include "bceditjournal.h"
 
 const char *BATTLE_CITY_URI = "BattleCity";
 
-static void initTankTextureFiles(QMap<QString, QString> &map, const QString &qrcPrefix, const QString &tankDir, const BattleCity::TankTexturesMap &texturesMap)
-{
-    QMap<BattleCity::MoveDirection, QString> directions;
-    directions[BattleCity::Forward] = "forward";
-    directions[BattleCity::Backward] = "backward";
-    directions[BattleCity::Left] = "left";
-    directions[BattleCity::Right] = "right";
-
-    QMap<BattleCity::MoveDirection, QString>::const_iterator dIt = directions.constBegin();
-    QMap<BattleCity::MoveDirection, QString>::const_iterator dEnd = directions.constEnd();
-    for (; dIt != dEnd; ++dIt) {
-        for (int i = 0; i < BattleCity::tankAnimationSteps; ++i)
-            map[texturesMap[dIt.key()][i]] = QString("%1%2%3_%4.png").arg(qrcPrefix).arg(tankDir).arg(*dIt).arg(i + 1);
-    }
-}
-
 void BattleCity::init()
 {
     qmlRegisterUncreatableType<BattleCity>(BATTLE_CITY_URI, 1, 0, "BattleCity", "");
     qmlRegisterUncreatableType<BCEnemyTank>(BATTLE_CITY_URI, 1, 0, "BCEnemyTank", "");
+    qmlRegisterUncreatableType<BCPlayerTank>(BATTLE_CITY_URI, 1, 0, "BCPlayerTank", "");
+    qmlRegisterUncreatableType<BCController>(BATTLE_CITY_URI, 1, 0, "BCController", "");
+    qmlRegisterUncreatableType<BCEffects>(BATTLE_CITY_URI, 1, 0, "BCEffects", "");
     // @uri BattleCity
     qmlRegisterType<BCBoard>(BATTLE_CITY_URI, 1, 0, "BCBoard");
     qmlRegisterType<BCMapsManager>(BATTLE_CITY_URI, 1, 0, "BCMapsManager");
     qmlRegisterType<Pixmap>(BATTLE_CITY_URI, 1, 0, "Pixmap");
+    qmlRegisterType<BCEditJournal>(BATTLE_CITY_URI, 1, 0, "BCEditJournal");
 
-    static const QString qrcPrefix = ":/battlecity/images/";
-
-    QMap<QString, QString> map;
-
-    ObstacleTexturesMap obstalcesFileNames;
-    obstalcesFileNames[Ground] = "ground.png";
-    obstalcesFileNames[BricksWall] = "bricks.png";
-    obstalcesFileNames[Ice] = "ice.png";
-    obstalcesFileNames[Water] = "water.png";
-    obstalcesFileNames[ConcreteWall] = "concrete.png";
-    obstalcesFileNames[Camouflage] = "camouflage.png";
-    obstalcesFileNames[Falcon] = "falcon_normal.png";
-    obstalcesFileNames[FalconDestroyed] = "falcon_destroyed.png";
-
-    static const QString obstaclesDir = "obstacles/";
-    static const QString cursorsDir = "cursors/";
-
-    ObstacleTexturesMap::const_iterator oIt = obstalcesFileNames.constBegin();
-    ObstacleTexturesMap::const_iterator oEnd = obstalcesFileNames.constEnd();
-    for (; oIt != oEnd; ++oIt) {
-        map[obstacleNames[oIt.key()]] = QString("%1%2%3").arg(qrcPrefix).arg(obstaclesDir).arg(*oIt);
-        if (oIt.key() == Falcon || oIt.key() == FalconDestroyed)
-            continue;
-        map[cursorNames[oIt.key()]] = QString("%1%2cursor_%3").arg(qrcPrefix).arg(cursorsDir).arg(*oIt);
-    }
-
-    static const QString basicTankDir = "tanks/basic/";
-    static const QString basicTankBonusDir = "tanks/basic/bonus/";
-    static const QString fastTankDir = "tanks/fast/";
-    static const QString fastTankBonusDir = "tanks/fast/bonus/";
-    static const QString powerTankDir = "tanks/power/";
-    static const QString powerTankBonusDir = "tanks/power/bonus/";
-    static const QString armorTankDir = "tanks/armor/";
-    static const QString armorTankBonusDir = "tanks/armor/bonus/";
-    static const QString armorTankGreenDir = "tanks/armor/green/";
-    static const QString armorTankGoldDir = "tanks/armor/gold/";
-    static const QString player1TankDir = "tanks/player1/";
-    static const QString player1TankOneStarDir = "tanks/player1/one_star/";
-    static const QString player1TankTwoStarsDir = "tanks/player1/two_stars/";
-    static const QString player1TankThreeStarsDir = "tanks/player1/three_stars/";
-
-    initTankTextureFiles(map, qrcPrefix, basicTankDir, basicTankNormalTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, basicTankBonusDir, basicTankBonusTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, fastTankDir, fastTankNormalTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, fastTankBonusDir, fastTankBonusTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, powerTankDir, powerTankNormalTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, powerTankBonusDir, powerTankBonusTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, armorTankDir, armorTankNormalTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, armorTankBonusDir, armorTankBonusTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, armorTankGreenDir, armorTankGreenTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, armorTankGoldDir, armorTankGoldTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, player1TankDir, player1TankTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, player1TankOneStarDir, player1TankOneStarTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, player1TankTwoStarsDir, player1TankTwoStarsTexturesNames);
-    initTankTextureFiles(map, qrcPrefix, player1TankThreeStarsDir, player1TankThreeStarsTexturesNames);
-
-    static const QString projectileDir = "projectile/";
-    ProjectileTexturesMap projectileTexturesFileNames;
-    projectileTexturesFileNames[Forward] = "forward.png";
-    projectileTexturesFileNames[Backward] = "backward.png";
-    projectileTexturesFileNames[Left] = "left.png";
-    projectileTexturesFileNames[Right] = "right.png";
-    ProjectileTexturesMap::const_iterator pIt = projectileTexturesFileNames.constBegin();
-    ProjectileTexturesMap::const_iterator pEnd = projectileTexturesFileNames.constEnd();
-    for (; pIt != pEnd; ++pIt)
-        map[projectileTextureNames[pIt.key()]] = QString("%1%2%3").arg(qrcPrefix).arg(projectileDir).arg(*pIt);
-
-    QPixmap pixmap;
-    QMap<QString, QString>::const_iterator it = map.constBegin();
-    for (; it != map.constEnd(); ++it) {
-        pixmap.load(it.value());
-        QPixmapCache::insert(it.key(), pixmap);
-    }
+    QVector<QPixmap> &pixmaps = textures();
+    const QVector<QImage> images = textureImages();
+    pixmaps.resize(texturesCount);
+    for (int id = 0; id < texturesCount; ++id)
+        pixmaps[id] = QPixmap::fromImage(images[id]);
 }
 
-static QPixmap pixmap(BattleCity::ObstacleType type, const BattleCity::ObstacleTexturesMap &map)
+// Created in init(), a QPixmap must not exist before the application.
+QVector<QPixmap> &BattleCity::textures()
 {
-    QPixmap pixmap;
-    QPixmapCache::find(map[type], &pixmap);
-    return pixmap;
+    static QVector<QPixmap> pixmaps;
+    return pixmaps;
 }
 
-static BattleCity::TankTexturesMap initTexturesMap(const QString &prefix)
+QPixmap BattleCity::texture(int id)
 {
-    BattleCity::TankTexturesMap map;
-
-    QMap<BattleCity::MoveDirection, QString> directions;
-    directions[BattleCity::Forward] = "Forward";
-    directions[BattleCity::Backward] = "Backward";
-    directions[BattleCity::Left] = "Left";
-    directions[BattleCity::Right] = "Right";
+    return textures().value(id);
+}
 
-    QMap<BattleCity::MoveDirection, QString>::const_iterator it = directions.constBegin();
-    QMap<BattleCity::MoveDirection, QString>::const_iterator end = directions.constEnd();
-    for (; it != end; ++it) {
-        QStringList list;
-        for (int i = 1; i <= BattleCity::tankAnimationSteps; ++i)
-            list << QString("%1%2%3").arg(prefix).arg(*it).arg(i);
-        map[it.key()] = list;
+// Image files of the textures, by obstacle type, direction and tank set.
+static const char qrcPrefix[] = ":/battlecity/images/";
+static const char *const obstacleFiles[BattleCity::obstacleTexturesCount] = {
+    "ground.png", "bricks.png", "concrete.png", "ice.png", "camouflage.png",
+    "falcon_normal.png", "falcon_destroyed.png", "water.png"
+};
+static const char *const directionFiles[4] = { "forward", "backward", "left", "right" };
+static const char *const tankDirs[BattleCity::TankTextureSetsCount] = {
+    "tanks/basic/", "tanks/basic/bonus/",
+    "tanks/fast/", "tanks/fast/bonus/",
+    "tanks/power/", "tanks/power/bonus/",
+    "tanks/armor/", "tanks/armor/bonus/",
+    "tanks/armor/green/", "tanks/armor/gold/",
+    "tanks/player1/", "tanks/player1/one_star/",
+    "tanks/player1/two_stars/", "tanks/player1/three_stars/"
+};
+
+QString BattleCity::textureFile(int id)
+{
+    QString file = QLatin1String(qrcPrefix);
+    if (id < obstacleTexturesCount)
+        return file + "obstacles/" + obstacleFiles[id];
+    id -= obstacleTexturesCount;
+    if (id < obstacleTexturesCount) {
+        if (Ground + id == Falcon || Ground + id == FalconDestroyed)
+            return QString();
+        return file + "cursors/cursor_" + obstacleFiles[id];
     }
-    return map;
+    id -= obstacleTexturesCount;
+    if (id < 4)
+        return file + "projectile/" + directionFiles[id] + ".png";
+    id -= 4;
+    const int step = id % tankAnimationSteps;
+    const int direction = id / tankAnimationSteps % 4;
+    const int set = id / tankAnimationSteps / 4;
+    return file + tankDirs[set] + directionFiles[direction] + '_' + QString::number(step + 1) + ".png";
 }
 
-static QPixmap pixmap(BattleCity::MoveDirection direction, int step, const BattleCity::TankTexturesMap &map)
+static QImage decodeTexture(int id)
 {
-    QPixmap pixmap;
-    QPixmapCache::find(map[direction][step], &pixmap);
-    return pixmap;
+    const QString fileName = BattleCity::textureFile(id);
+    if (fileName.isEmpty())
+        return QImage();
+    return QImage(fileName).convertToFormat(QImage::Format_ARGB32_Premultiplied);
 }
 
-static BattleCity::ObstacleTexturesMap initObstaclesMap()
+QVector<QImage> BattleCity::decodeTextureFiles()
 {
-    BattleCity::ObstacleTexturesMap map;
-    map[BattleCity::Ground] = "ground";
-    map[BattleCity::Ice] = "ice";
-    map[BattleCity::BricksWall] = "bricks";
-    map[BattleCity::ConcreteWall] = "concrete";
-    map[BattleCity::Camouflage] = "camouflage";
-    map[BattleCity::Water] = "water";
-    map[BattleCity::Falcon] = "falconNormal";
-    map[BattleCity::FalconDestroyed] = "falconDestroyed";
-    return map;
+    QList<int> ids;
+    for (int id = 0; id < texturesCount; ++id)
+        ids << id;
+    return QtConcurrent::blockingMapped<QList<QImage> >(ids, decodeTexture).toVector();
 }
 
-const BattleCity::ObstacleTexturesMap BattleCity::obstacleNames = initObstaclesMap();
+// Blob layout: magic, version, byte order and count, then for every texture
+// id its width and height and, 4 bytes aligned, the premultiplied ARGB32
+// pixels in the byte order of the machine that wrote it.
+static const char *textureBlobPath = ":/battlecity/textures.bctx";
+static const quint32 textureBlobMagic = 0x42435458;
+static const quint32 textureBlobVersion = 2;
 
-QPixmap BattleCity::obstacleTexture(ObstacleType type)
+static void alignBlob(QIODevice *device, bool write)
 {
-    return pixmap(type, obstacleNames);
+    const int padding = (4 - device->pos() % 4) % 4;
+    if (write)
+        device->write(QByteArray(padding, 0));
+    else
+        device->seek(device->pos() + padding);
 }
 
-static BattleCity::ObstacleTexturesMap initCursorsMap()
+bool BattleCity::writeTextureBlob(QIODevice *device)
 {
-    BattleCity::ObstacleTexturesMap map;
-    map[BattleCity::Ground] = "cursorGroud";
-    map[BattleCity::Ice] = "cursorIce";
-    map[BattleCity::BricksWall] = "cursorBricks";
-    map[BattleCity::ConcreteWall] = "cursorConcrete";
-    map[BattleCity::Camouflage] = "cursorCamouflage";
-    map[BattleCity::Water] = "cursorWater";
-    return map;
+    const QVector<QImage> images = decodeTextureFiles();
+    QDataStream out(device);
+    out << textureBlobMagic << textureBlobVersion << quint32(QSysInfo::ByteOrder) << quint32(images.count());
+    foreach (const QImage &image, images) {
+        out << qint32(image.width()) << qint32(image.height());
+        alignBlob(device, true);
+        for (int y = 0; y < image.height(); ++y)
+            out.writeRawData(reinterpret_cast<const char *>(image.constScanLine(y)), image.width() * 4);
+    }
+    return out.status() == QDataStream::Ok;
 }
 
-const BattleCity::ObstacleTexturesMap BattleCity::cursorNames = initCursorsMap();
-
-QPixmap BattleCity::cursorPixmap(ObstacleType type)
+// The images point into the resource data unless it is compressed or
+// misaligned, then the blob is uncompressed or the pixels copied once.
+static bool readTextureBlob(QVector<QImage> *images)
 {
-    return pixmap(type, cursorNames);
+    QResource resource(textureBlobPath);
+    if (!resource.isValid())
+        return false;
+    static QByteArray blob;
+    if (resource.isCompressed())
+        blob = qUncompress(resource.data(), resource.size());
+    else
+        blob = QByteArray::fromRawData(reinterpret_cast<const char *>(resource.data()), resource.size());
+
+    QBuffer buffer(&blob);
+    buffer.open(QIODevice::ReadOnly);
+    QDataStream in(&buffer);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 byteOrder = 0;
+    quint32 count = 0;
+    in >> magic >> version >> byteOrder >> count;
+    if (magic != textureBlobMagic || version != textureBlobVersion || byteOrder != quint32(QSysInfo::ByteOrder)
+            || count != quint32(BattleCity::texturesCount))
+        return false;
+
+    images->resize(count);
+    for (quint32 id = 0; id < count && in.status() == QDataStream::Ok; ++id) {
+        qint32 width = 0;
+        qint32 height = 0;
+        in >> width >> height;
+        alignBlob(&buffer, false);
+        const qint64 size = qint64(width) * height * 4;
+        if (width < 0 || height < 0 || buffer.pos() + size > blob.size())
+            return false;
+        if (!size)
+            continue;
+        const uchar *pixels = reinterpret_cast<const uchar *>(blob.constData() + buffer.pos());
+        const QImage image(pixels, width, height, width * 4, QImage::Format_ARGB32_Premultiplied);
+        (*images)[id] = quintptr(pixels) % 4 ? image.copy() : image;
+        buffer.seek(buffer.pos() + size);
+    }
+    return in.status() == QDataStream::Ok;
 }
 
-static BattleCity::ProjectileTexturesMap initProjectileTextures()
+QVector<QImage> BattleCity::textureImages()
 {
-    BattleCity::ProjectileTexturesMap map;
-    map[BattleCity::Forward] = "projectileForward";
-    map[BattleCity::Right] = "projectileRight";
-    map[BattleCity::Backward] = "projectileBackward";
-    map[BattleCity::Left] = "projectileLeft";
-    return map;
+    static QVector<QImage> images;
+    if (images.isEmpty() && !readTextureBlob(&images))
+        images = decodeTextureFiles();
+    return images;
 }
 
-const BattleCity::ProjectileTexturesMap BattleCity::projectileTextureNames = initProjectileTextures();
-
-QPixmap BattleCity::projectileTexture(MoveDirection direction)
+QPixmap BattleCity::obstacleTexture(ObstacleType type)
 {
-    QPixmap pixmap;
-    QPixmapCache::find(projectileTextureNames[direction], &pixmap);
-    return pixmap;
+    return texture(obstacleTextureId(type));
 }
 
-const BattleCity::TankTexturesMap BattleCity::basicTankNormalTexturesNames = initTexturesMap("basicTank");
-const BattleCity::TankTexturesMap BattleCity::basicTankBonusTexturesNames = initTexturesMap("basicTankBonus");
-const BattleCity::TankTexturesMap BattleCity::fastTankNormalTexturesNames = initTexturesMap("fastTank");
-const BattleCity::TankTexturesMap BattleCity::fastTankBonusTexturesNames = initTexturesMap("fastTankBonus");
-const BattleCity::TankTexturesMap BattleCity::powerTankNormalTexturesNames = initTexturesMap("powerTank");
-const BattleCity::TankTexturesMap BattleCity::powerTankBonusTexturesNames = initTexturesMap("powerTankBonus");
-const BattleCity::TankTexturesMap BattleCity::armorTankNormalTexturesNames = initTexturesMap("armorTank");
-const BattleCity::TankTexturesMap BattleCity::armorTankBonusTexturesNames = initTexturesMap("armorTankBonus");
-const BattleCity::TankTexturesMap BattleCity::armorTankGreenTexturesNames = initTexturesMap("armorTankGreen");
-const BattleCity::TankTexturesMap BattleCity::armorTankGoldTexturesNames = initTexturesMap("armorTankGold");
-
-QMap<BattleCity::TankType, BattleCity::TankTexturesMap> BattleCity::initNormalTankTexturesMap()
+QPixmap BattleCity::cursorPixmap(ObstacleType type)
 {
-    QMap<BattleCity::TankType, BattleCity::TankTexturesMap> map;
-    map[BattleCity::Basic] = BattleCity::basicTankNormalTexturesNames;
-    map[BattleCity::Fast] = BattleCity::fastTankNormalTexturesNames;
-    map[BattleCity::Power] = BattleCity::powerTankNormalTexturesNames;
-    map[BattleCity::Armor] = BattleCity::armorTankNormalTexturesNames;
-    return map;
+    return texture(cursorTextureId(type));
 }
 
-QMap<BattleCity::TankType, BattleCity::TankTexturesMap> BattleCity::initBonusTankTexturesMap()
+QPixmap BattleCity::projectileTexture(MoveDirection direction)
 {
-    QMap<BattleCity::TankType, BattleCity::TankTexturesMap> map;
-    map[BattleCity::Basic] = BattleCity::basicTankBonusTexturesNames;
-    map[BattleCity::Fast] = BattleCity::fastTankBonusTexturesNames;
-    map[BattleCity::Power] = BattleCity::powerTankBonusTexturesNames;
-    map[BattleCity::Armor] = BattleCity::armorTankBonusTexturesNames;
-    return map;
+    return texture(projectileTextureId(direction));
 }
 
-const QMap<BattleCity::TankType, BattleCity::TankTexturesMap> BattleCity::normalTankTextures = initNormalTankTexturesMap();
-const QMap<BattleCity::TankType, BattleCity::TankTexturesMap> BattleCity::bonusTankTextures = initBonusTankTexturesMap();
-
 QPixmap BattleCity::tankTexture(TankType type, MoveDirection direction, int step, bool bonus)
 {
-    return bonus ? pixmap(direction, step, bonusTankTextures[type]) : pixmap(direction, step, normalTankTextures[type]);
+    if (type < Basic || type > Armor)
+        return QPixmap();
+    return texture(tankTextureId(TankTextureSet((type - Basic) * 2 + (bonus ? 1 : 0)), direction, step));
 }
 
 QPixmap BattleCity::armorTankGoldTexture(MoveDirection direction, int step)
 {
-    return pixmap(direction, step, armorTankGoldTexturesNames);
+    return texture(tankTextureId(ArmorGoldTankTextures, direction, step));
 }
 
 QPixmap BattleCity::armorTankGreenTexture(MoveDirection direction, int step)
 {
-    return pixmap(direction, step, armorTankGreenTexturesNames);
+    return texture(tankTextureId(ArmorGreenTankTextures, direction, step));
 }
 
-const BattleCity::TankTexturesMap BattleCity::player1TankTexturesNames = initTexturesMap("player1TankNoStars");
-const BattleCity::TankTexturesMap BattleCity::player1TankOneStarTexturesNames = initTexturesMap("player1TankOneStar");
-const BattleCity::TankTexturesMap BattleCity::player1TankTwoStarsTexturesNames = initTexturesMap("player1TankTwoStars");
-const BattleCity::TankTexturesMap BattleCity::player1TankThreeStarsTexturesNames = initTexturesMap("player1TankThreeStars");
-
 QPixmap BattleCity::player1TankTexture(MoveDirection direction, int step)
 {
-    return pixmap(direction, step, player1TankTexturesNames);
+    return texture(tankTextureId(PlayerTankTextures, direction, step));
 }
 
 QPixmap BattleCity::player1TankOneStarTexture(MoveDirection direction, int step)
 {
-    return pixmap(direction, step, player1TankOneStarTexturesNames);
+    return texture(tankTextureId(PlayerOneStarTankTextures, direction, step));
 }
 
 QPixmap BattleCity::player1TankTwoStarsTexture(MoveDirection direction, int step)
 {
-    return pixmap(direction, step, player1TankTwoStarsTexturesNames);
+    return texture(tankTextureId(PlayerTwoStarsTankTextures, direction, step));
 }
 
 QPixmap BattleCity::player1TankThreeStarsTexture(MoveDirection direction, int step)
 {
-    return pixmap(direction, step, player1TankThreeStarsTexturesNames);
+    return texture(tankTextureId(PlayerThreeStarsTankTextures, direction, step));
 }
 
 Pixmap::Pixmap(QDeclarativeItem *parent)
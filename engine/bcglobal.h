@@ -18,6 +18,8 @@
 #define BATTLECITYGLOBAL_H
 
 #include <QString>
+#include <QVector>
+#include <QImage>
 #include <QDeclarativeItem>
 
 class BattleCity : public QObject
@@ -27,22 +29,58 @@ class BattleCity : public QObject
     Q_ENUMS(ObstacleType)
     Q_ENUMS(TankType)
     Q_ENUMS(MoveDirection)
+    Q_ENUMS(BonusType)
 public:
     enum MoveDirection { Forward, Backward, Left, Right };
     enum ObstacleType { Ground = QDeclarativeItem::UserType + 1, BricksWall, ConcreteWall, Ice, Camouflage, Falcon, FalconDestroyed, Water };
     enum ItemProperty { Traversable, Nontraversable, Destroyable, Movable };
-    enum TankType { Basic = Water + 1, Fast, Power, Armor };
+    enum TankType { Basic = Water + 1, Fast, Power, Armor, Player };
+    enum ItemType { Bonus = Player + 1 };
+    enum BonusType { StarBonus, GrenadeBonus, HelmetBonus, ShovelBonus, TimerBonus, TankBonus };
     enum Edge { NoneEdge, TopEdge, RightEdge, BottomEdge, LeftEdge };
 
-    typedef QMap<ObstacleType, QString> ObstacleTexturesMap;
-    typedef QMap<MoveDirection, QStringList> TankTexturesMap;
-    typedef QMap<MoveDirection, QString> ProjectileTexturesMap;
+    enum TankTextureSet {
+        BasicTankTextures, BasicBonusTankTextures, FastTankTextures, FastBonusTankTextures,
+        PowerTankTextures, PowerBonusTankTextures, ArmorTankTextures, ArmorBonusTankTextures,
+        ArmorGreenTankTextures, ArmorGoldTankTextures, PlayerTankTextures, PlayerOneStarTankTextures,
+        PlayerTwoStarsTankTextures, PlayerThreeStarsTankTextures, TankTextureSetsCount
+    };
 
     BattleCity(QObject *parent = 0) : QObject(parent) { }
 
     static void init();
 
     static const quint8 tankAnimationSteps = 2;
+    static const int tickInterval = 30;
+
+    // The simulation measures lengths in integer units, whatever the cell
+    // size on screen: an obstacle cell is cellUnits long, a board cell (and
+    // a tank) twice that. 336 keeps every speed and size a whole number.
+    static const int cellUnits = 336;
+    static const int tankUnits = 2 * cellUnits;
+    // The obstacle cell a unit coordinate falls in, rounding down.
+    static int unitsToCell(int units) { return units >= 0 ? units / cellUnits : (units + 1) / cellUnits - 1; }
+
+    // Textures are numbered: obstacles and their cursors by type, projectiles
+    // by direction, then tanks by set, direction and step. Falcons have no
+    // cursor, their ids are null textures.
+    static const int obstacleTexturesCount = Water - Ground + 1;
+    static const int texturesCount = 2 * obstacleTexturesCount + 4 + TankTextureSetsCount * 4 * tankAnimationSteps;
+    static int obstacleTextureId(ObstacleType type) { return type - Ground; }
+    static int cursorTextureId(ObstacleType type) { return obstacleTexturesCount + type - Ground; }
+    static int projectileTextureId(MoveDirection direction) { return 2 * obstacleTexturesCount + direction; }
+    static int tankTextureId(TankTextureSet set, MoveDirection direction, int step)
+    { return 2 * obstacleTexturesCount + 4 + (set * 4 + direction) * tankAnimationSteps + step; }
+
+    static QPixmap texture(int id);
+    static QString textureFile(int id);
+
+    // Every texture by id, premultiplied. Taken from the texture blob in
+    // the resources when the build has one, else decoded from the image
+    // files in parallel. Built once, in the main thread.
+    static QVector<QImage> textureImages();
+    // The blob texturepacker writes, see app.pro.
+    static bool writeTextureBlob(QIODevice *device);
 
     Q_INVOKABLE static QPixmap obstacleTexture(ObstacleType type);
     static QPixmap cursorPixmap(ObstacleType type);
@@ -60,32 +98,8 @@ public:
     static QPixmap player1TankThreeStarsTexture(MoveDirection direction, int step);
 
 private:
-    static QMap<TankType, TankTexturesMap> initNormalTankTexturesMap();
-    static QMap<TankType, TankTexturesMap> initBonusTankTexturesMap();
-
-private:
-    static const ObstacleTexturesMap obstacleNames;
-    static const ObstacleTexturesMap cursorNames;
-    static const ProjectileTexturesMap projectileTextureNames;
-
-    static const TankTexturesMap basicTankNormalTexturesNames;
-    static const TankTexturesMap basicTankBonusTexturesNames;
-    static const TankTexturesMap fastTankNormalTexturesNames;
-    static const TankTexturesMap fastTankBonusTexturesNames;
-    static const TankTexturesMap powerTankNormalTexturesNames;
-    static const TankTexturesMap powerTankBonusTexturesNames;
-    static const TankTexturesMap armorTankNormalTexturesNames;
-    static const TankTexturesMap armorTankBonusTexturesNames;
-    static const TankTexturesMap armorTankGreenTexturesNames;
-    static const TankTexturesMap armorTankGoldTexturesNames;
-
-    static const TankTexturesMap player1TankTexturesNames;
-    static const TankTexturesMap player1TankOneStarTexturesNames;
-    static const TankTexturesMap player1TankTwoStarsTexturesNames;
-    static const TankTexturesMap player1TankThreeStarsTexturesNames;
-
-    static const QMap<TankType, TankTexturesMap> normalTankTextures;
-    static const QMap<TankType, TankTexturesMap> bonusTankTextures;
+    static QVector<QPixmap> &textures();
+    static QVector<QImage> decodeTextureFiles();
 };
 
 class Pixmap : public QDeclarativeItem
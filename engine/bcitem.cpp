@@ -16,32 +16,43 @@
 #include <QPainter>
 #include <QStyleOptionGraphicsItem>
 #include <QPixmapCache>
-#include <QTimer>
 #include <QGraphicsScene>
 
 #include "bcitem.h"
 #include "bcglobal.h"
 #include "bcboard.h"
+#include "bcboardstate.h"
 
 BCItem::BCItem(BCBoard *parent) :
-    QDeclarativeItem(parent),
-    m_board(parent)
+    QDeclarativeItem(parent ? parent->world() : 0),
+    m_board(parent),
+    m_unitRect(0, 0, BattleCity::cellUnits, BattleCity::cellUnits)
 {
     setFlag(ItemHasNoContents, false);
     setClip(true);
     setZValue(0);
+    setImplicitWidth(m_unitRect.width());
+    setImplicitHeight(m_unitRect.height());
 }
 
 void BCItem::setPosition(int row, int column)
 {
     m_position.setX(column);
     m_position.setY(row);
-    reposItem();
+    setUnitPos(column * m_unitRect.width(), row * m_unitRect.height());
 }
 
-void BCItem::reposItem()
+void BCItem::setUnitPos(int x, int y)
 {
-    setPos(column() * implicitWidth(), row() * implicitHeight());
+    m_unitRect.moveTo(x, y);
+    setPos(x, y);
+}
+
+void BCItem::setUnitSize(int size)
+{
+    m_unitRect.setSize(QSize(size, size));
+    setImplicitWidth(size);
+    setImplicitHeight(size);
 }
 
 #ifdef BC_DEBUG_RECT
@@ -96,51 +107,73 @@ bool BCMovableItem::move(BattleCity::MoveDirection direction)
     if (m_direction != direction)
         m_direction = direction;
 
-    qreal speed = this->speed();
-    qreal x = this->x();
-    qreal y = this->y();
-    QRectF viewRect;
-    static const qreal extraPixel = 1.0;
+    const QRect rect = unitRect();
+    const int speed = this->speed();
+    int x = rect.x();
+    int y = rect.y();
+    QRect viewRect;
+    static const int extraUnit = 1;
 
     if (direction == BattleCity::Left) {
         x -= speed;
-        viewRect.setRect(this->x() - speed, this->y(), speed, implicitHeight() + extraPixel);
+        viewRect.setRect(rect.x() - speed, rect.y(), speed, rect.height() + extraUnit);
     }
     if (direction == BattleCity::Right) {
         x += speed;
-        viewRect.setRect(this->x() + implicitWidth() + speed + extraPixel, this->y(), speed, implicitHeight() + extraPixel);
+        viewRect.setRect(rect.x() + rect.width() + speed + extraUnit, rect.y(), speed, rect.height() + extraUnit);
     }
     if (direction == BattleCity::Forward) {
         y -= speed;
-        viewRect.setRect(this->x(), this->y() - speed, implicitWidth() + extraPixel, speed);
+        viewRect.setRect(rect.x(), rect.y() - speed, rect.width() + extraUnit, speed);
     }
     if (direction == BattleCity::Backward) {
         y += speed;
-        viewRect.setRect(this->x(), this->y() + implicitHeight() + speed + extraPixel, implicitWidth() + extraPixel, speed);
+        viewRect.setRect(rect.x(), rect.y() + rect.height() + speed + extraUnit, rect.width() + extraUnit, speed);
     }
 
 #ifdef BC_DEBUG_RECT
-    board()->setDebugRect(viewRect);
+    board()->setDebugRect(board()->mapFromUnits(viewRect));
 #endif
 
     const BattleCity::Edge edge = intersectsBoardBoundingRect(x, y, direction);
     bool res = edge == BattleCity::NoneEdge ? true : false;
     if (edge == BattleCity::NoneEdge) {
         BattleCity::Edge obstacleEdge = BattleCity::NoneEdge;
-        const BCItem *obstacle = collidesWithObstacle(viewRect, direction, &obstacleEdge);
+        BCItem *obstacle = collidesWithObstacle(viewRect, direction, &obstacleEdge);
         res = obstacleEdge == BattleCity::NoneEdge ? true : false;
+        if (obstacle)
+            obstacleHit(obstacle);
         adjustIntersectionPointWithObstacle(obstacle, obstacleEdge, x, y);
     } else {
         adjustIntersectionPointWithBoardBoundingRect(edge, x, y);
     }
 
-    setPos(x, y);
+    setUnitPos(x, y);
     update();
     return res;
 }
 
-BattleCity::Edge BCMovableItem::intersectsBoardBoundingRect(qreal x, qreal y, BattleCity::MoveDirection direction) const
+void BCMovableItem::saveState(BCMovableState *state) const
+{
+    state->x = unitRect().x();
+    state->y = unitRect().y();
+    state->direction = m_direction;
+    state->visible = isVisible();
+}
+
+void BCMovableItem::restoreState(const BCMovableState &state)
+{
+    setUnitPos(state.x, state.y);
+    m_direction = BattleCity::MoveDirection(state.direction);
+    setVisible(state.visible);
+}
+
+BattleCity::Edge BCMovableItem::intersectsBoardBoundingRect(int x, int y, BattleCity::MoveDirection direction) const
 {
+    // An item may end flush with any edge: only going past one is a hit. The
+    // pixel geometry compared with >= against a board one pixel wider than
+    // its cells, which is the same test on the right and bottom edges.
+    const int boardUnits = board()->unitSize();
     BattleCity::Edge edge = BattleCity::NoneEdge;
     switch (direction) {
     case BattleCity::Left:
@@ -148,7 +181,7 @@ BattleCity::Edge BCMovableItem::intersectsBoardBoundingRect(qreal x, qreal y, Ba
             edge = BattleCity::LeftEdge;
         break;
     case BattleCity::Right:
-        if ((x + implicitWidth()) >= board()->implicitWidth())
+        if (x + unitRect().width() > boardUnits)
             edge = BattleCity::RightEdge;
         break;
     case BattleCity::Forward:
@@ -156,54 +189,91 @@ BattleCity::Edge BCMovableItem::intersectsBoardBoundingRect(qreal x, qreal y, Ba
             edge = BattleCity::TopEdge;
         break;
     case  BattleCity::Backward:
-        if ((y + implicitHeight()) >= board()->implicitHeight())
+        if (y + unitRect().height() > boardUnits)
             edge = BattleCity::BottomEdge;
         break;
     }
     return edge;
 }
 
-BCItem *BCMovableItem::collidesWithObstacle(const QRectF &viewRect, BattleCity::MoveDirection direction, BattleCity::Edge *edge) const
+// Orders candidate obstacles by distance along the move direction, then along
+// the perpendicular axis, so the result does not depend on the scene index order.
+static bool closerObstacle(const BCItem *a, const BCItem *b, BattleCity::MoveDirection direction)
 {
-    const QList<QGraphicsItem *> items = scene()->items(viewRect);
-    foreach (QGraphicsItem *item, items) {
-        BCItem *obstacle = qobject_cast<BCItem *>(item);
-        if (item == this || !obstacle || obstacle->itemProperty() == BattleCity::Traversable)
+    const QRect &ra = a->unitRect();
+    const QRect &rb = b->unitRect();
+    switch (direction) {
+    case BattleCity::Left:
+        return ra.x() != rb.x() ? ra.x() > rb.x() : ra.y() < rb.y();
+    case BattleCity::Right:
+        return ra.x() != rb.x() ? ra.x() < rb.x() : ra.y() < rb.y();
+    case BattleCity::Forward:
+        return ra.y() != rb.y() ? ra.y() > rb.y() : ra.x() < rb.x();
+    case BattleCity::Backward:
+        return ra.y() != rb.y() ? ra.y() < rb.y() : ra.x() < rb.x();
+    }
+    return false;
+}
+
+BCItem *BCMovableItem::collidesWithObstacle(const QRect &viewRect, BattleCity::MoveDirection direction, BattleCity::Edge *edge) const
+{
+    BCItem *closest = 0;
+
+    // Cells come from the tile grid and the terrain table, by index.
+    const BCBoard *board = this->board();
+    const BCTileStore &tiles = board->tiles();
+    const int firstRow = qMax(0, BattleCity::unitsToCell(viewRect.y()));
+    const int lastRow = qMin(tiles.gridSize() - 1, BattleCity::unitsToCell(viewRect.y() + viewRect.height()));
+    const int firstColumn = qMax(0, BattleCity::unitsToCell(viewRect.x()));
+    const int lastColumn = qMin(tiles.gridSize() - 1, BattleCity::unitsToCell(viewRect.x() + viewRect.width()));
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            if (!(BCTerrain::flags(tiles.at(row, column)) & m_blockingTerrain))
+                continue;
+            BCItem *obstacle = board->obstacle(row, column);
+            if (viewRect.intersects(obstacle->unitRect()) && (!closest || closerObstacle(obstacle, closest, direction)))
+                closest = obstacle;
+        }
+    }
+
+    for (int i = 0; i < board->actorsCount(); ++i) {
+        BCItem *actor = board->actor(i);
+        if (!actor || actor == this || !actor->isVisible())
             continue;
-        const QRectF obstacleRect(obstacle->x(), obstacle->y(), obstacle->implicitWidth(), obstacle->implicitHeight());
-        if (viewRect.intersects(obstacleRect)) {
-            if (edge) {
-                switch (direction) {
-                case BattleCity::Left:
-                    (*edge) = BattleCity::RightEdge;
-                    break;
-                case BattleCity::Right:
-                    (*edge) = BattleCity::LeftEdge;
-                    break;
-                case BattleCity::Forward:
-                    (*edge) = BattleCity::BottomEdge;
-                    break;
-                case BattleCity::Backward:
-                    (*edge) = BattleCity::TopEdge;
-                    break;
-                }
+        if (viewRect.intersects(actor->unitRect()) && (!closest || closerObstacle(actor, closest, direction)))
+            closest = actor;
+    }
+
+    if (edge) {
+        (*edge) = BattleCity::NoneEdge;
+        if (closest) {
+            switch (direction) {
+            case BattleCity::Left:
+                (*edge) = BattleCity::RightEdge;
+                break;
+            case BattleCity::Right:
+                (*edge) = BattleCity::LeftEdge;
+                break;
+            case BattleCity::Forward:
+                (*edge) = BattleCity::BottomEdge;
+                break;
+            case BattleCity::Backward:
+                (*edge) = BattleCity::TopEdge;
+                break;
             }
-            return obstacle;
         }
     }
-    if (edge)
-        (*edge) = BattleCity::NoneEdge;
-    return 0;
+    return closest;
 }
 
-void BCMovableItem::adjustIntersectionPointWithBoardBoundingRect(BattleCity::Edge edge, qreal &x, qreal &y) const
+void BCMovableItem::adjustIntersectionPointWithBoardBoundingRect(BattleCity::Edge edge, int &x, int &y) const
 {
     Q_UNUSED(edge);
     Q_UNUSED(x);
     Q_UNUSED(y);
 }
 
-void BCMovableItem::adjustIntersectionPointWithObstacle(const BCItem *obstacle, BattleCity::Edge edge, qreal &x, qreal &y) const
+void BCMovableItem::adjustIntersectionPointWithObstacle(const BCItem *obstacle, BattleCity::Edge edge, int &x, int &y) const
 {
     Q_UNUSED(obstacle);
     Q_UNUSED(edge);
@@ -211,12 +281,13 @@ void BCMovableItem::adjustIntersectionPointWithObstacle(const BCItem *obstacle,
     Q_UNUSED(y);
 }
 
-BCProjectile::BCProjectile(qreal speed, BattleCity::MoveDirection direction, BCBoard *parent) :
-    BCMovableItem(direction, parent),
-    m_speed(speed)
+BCProjectile::BCProjectile(BCAbstractTank *owner, BCBoard *parent) :
+    BCMovableItem(BattleCity::Forward, BCTerrain::BlocksProjectiles, parent),
+    m_owner(owner),
+    m_target(0),
+    m_speed(0)
 {
-    m_timer = new QTimer(this);
-    connect(m_timer, SIGNAL(timeout()), SLOT(timerFired()));
+    setUnitSize(BattleCity::tankUnits / 6);
 }
 
 void BCProjectile::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
@@ -225,16 +296,52 @@ void BCProjectile::paint(QPainter *painter, const QStyleOptionGraphicsItem *opti
     painter->drawPixmap(option->rect, BattleCity::projectileTexture(direction()));
 }
 
-void BCProjectile::launch()
+void BCProjectile::launch(const QPoint &pos, BattleCity::MoveDirection direction, int speed)
 {
-    m_timer->start();
+    setUnitPos(pos.x(), pos.y());
+    setDirection(direction);
+    m_speed = speed;
+    m_target = 0;
+    show();
 }
 
-void BCProjectile::timerFired()
+bool BCProjectile::step()
 {
-    if (move(direction())) {
-        m_timer->start();
-    } else {
-        emit exploded();
-    }
+    return move(direction());
+}
+
+void BCProjectile::stop()
+{
+    hide();
+}
+
+void BCProjectile::saveState(BCProjectileState *state) const
+{
+    BCMovableItem::saveState(state);
+    state->speed = m_speed;
+}
+
+void BCProjectile::restoreState(const BCProjectileState &state)
+{
+    m_speed = state.speed;
+    BCMovableItem::restoreState(state);
+    m_target = 0;
+}
+
+void BCBonus::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(widget);
+    // There are no power-up textures yet, a framed letter stands in for them.
+    static const char labels[] = "SGHFTL";
+    QPen pen(Qt::white, 2);
+    pen.setCosmetic(true);
+    const int margin = option->rect.width() / 32;
+    painter->setPen(pen);
+    painter->setBrush(QColor(0x60, 0x20, 0x20));
+    painter->drawRect(option->rect.adjusted(margin, margin, -margin, -margin));
+    QFont font = painter->font();
+    font.setBold(true);
+    font.setPixelSize(option->rect.height() / 2);
+    painter->setFont(font);
+    painter->drawText(option->rect, Qt::AlignCenter, QString(QLatin1Char(labels[m_bonusType])));
 }
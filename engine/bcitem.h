@@ -19,11 +19,14 @@
 
 #include <QDeclarativeItem>
 #include <QPoint>
+#include <QRect>
 
 #include "bcglobal.h"
 
 class BCBoard;
-class QTimer;
+class BCAbstractTank;
+struct BCMovableState;
+struct BCProjectileState;
 
 class BCItem : public QDeclarativeItem
 {
@@ -41,7 +44,9 @@ public:
     int row() const { return m_position.y(); }
     int column() const { return m_position.x(); }
 
-    qreal size() const { return implicitWidth(); }
+    // Geometry in simulation units, which are also the item coordinates:
+    // the board world item maps them to the screen.
+    const QRect &unitRect() const { return m_unitRect; }
 
     virtual BattleCity::ItemProperty itemProperty() const = 0;
 
@@ -49,27 +54,16 @@ public:
 
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
 
-public slots:
-    void setSize(qreal size)
-    {
-        setImplicitWidth(size);
-        setImplicitHeight(size);
-        reposItem();
-        emit sizeChanged(size);
-    }
-
-signals:
-    void sizeChanged(qreal size);
-
 protected:
+    // Cell position in multiples of the item size.
     void setPosition(int row, int column);
-
-private:
-    void reposItem();
+    void setUnitPos(int x, int y);
+    void setUnitSize(int size);
 
 private:
     BCBoard *m_board;
     QPoint m_position;
+    QRect m_unitRect;
 };
 
 class BCTraversableItem : public BCItem
@@ -106,46 +100,61 @@ class BCMovableItem : public BCItem
 {
     Q_OBJECT
 public:
-    BCMovableItem(BattleCity::MoveDirection direction, BCBoard *parent = 0) :
-        BCItem(parent), m_direction(direction) { setZValue(1); }
+    // blockingTerrain: BCTerrain flags of the cells the item cannot enter.
+    BCMovableItem(BattleCity::MoveDirection direction, quint8 blockingTerrain, BCBoard *parent = 0) :
+        BCItem(parent), m_direction(direction), m_blockingTerrain(blockingTerrain) { setZValue(1); }
 
     BattleCity::ItemProperty itemProperty() const { return BattleCity::Movable; }
 
     virtual bool move(BattleCity::MoveDirection direction);
-    virtual qreal speed() const = 0;
+    // Units per tick.
+    virtual int speed() const = 0;
+
+    void saveState(BCMovableState *state) const;
+    void restoreState(const BCMovableState &state);
 
-protected:
     BattleCity::MoveDirection direction() const { return m_direction; }
-    virtual BattleCity::Edge intersectsBoardBoundingRect(qreal x, qreal y, BattleCity::MoveDirection direction) const;
-    virtual BCItem *collidesWithObstacle(const QRectF &viewRect, BattleCity::MoveDirection direction, BattleCity::Edge *edge = 0) const;
-    virtual void adjustIntersectionPointWithBoardBoundingRect(BattleCity::Edge edge, qreal &x, qreal &y) const;
-    virtual void adjustIntersectionPointWithObstacle(const BCItem *obstacle, BattleCity::Edge edge, qreal &x, qreal &y) const;
+
+protected:
+    void setDirection(BattleCity::MoveDirection direction) { m_direction = direction; }
+    virtual BattleCity::Edge intersectsBoardBoundingRect(int x, int y, BattleCity::MoveDirection direction) const;
+    virtual BCItem *collidesWithObstacle(const QRect &viewRect, BattleCity::MoveDirection direction, BattleCity::Edge *edge = 0) const;
+    virtual void adjustIntersectionPointWithBoardBoundingRect(BattleCity::Edge edge, int &x, int &y) const;
+    virtual void adjustIntersectionPointWithObstacle(const BCItem *obstacle, BattleCity::Edge edge, int &x, int &y) const;
+    virtual void obstacleHit(BCItem *obstacle) { Q_UNUSED(obstacle); }
 
 private:
     BattleCity::MoveDirection m_direction;
+    quint8 m_blockingTerrain;
 };
 
 class BCProjectile : public BCMovableItem
 {
     Q_OBJECT
 public:
-    explicit BCProjectile(qreal speed, BattleCity::MoveDirection direction, BCBoard *parent = 0);
+    explicit BCProjectile(BCAbstractTank *owner, BCBoard *parent = 0);
 
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
 
-    qreal speed() const { return m_speed; }
+    int speed() const { return m_speed; }
+
+    BCAbstractTank *owner() const { return m_owner; }
+    BCItem *target() const { return m_target; }
 
-    void launch();
+    void launch(const QPoint &pos, BattleCity::MoveDirection direction, int speed);
+    bool step();
+    void stop();
 
-signals:
-    void exploded();
+    void saveState(BCProjectileState *state) const;
+    void restoreState(const BCProjectileState &state);
 
-private slots:
-    void timerFired();
+protected:
+    void obstacleHit(BCItem *obstacle) { m_target = obstacle; }
 
 private:
-    qreal m_speed;
-    QTimer *m_timer;
+    BCAbstractTank *m_owner;
+    BCItem *m_target;
+    int m_speed;
 };
 
 class BCGroud : public BCTraversableItem
@@ -173,7 +182,7 @@ class BCCamouflage : public BCTraversableItem
     Q_OBJECT
 public:
     explicit BCCamouflage(BCBoard *parent = 0) :
-        BCTraversableItem(parent) { setZValue(1); }
+        BCTraversableItem(parent) { setZValue(2); }
 
     int type() const { return BattleCity::Camouflage; }
 };
@@ -208,14 +217,38 @@ public:
     int type() const { return BattleCity::ConcreteWall; }
 };
 
+class BCBonus : public BCTraversableItem
+{
+    Q_OBJECT
+public:
+    explicit BCBonus(BCBoard *parent = 0) :
+        BCTraversableItem(parent), m_bonusType(BattleCity::StarBonus) { setUnitSize(BattleCity::tankUnits); setZValue(3); }
+
+    int type() const { return BattleCity::Bonus; }
+
+    BattleCity::BonusType bonusType() const { return m_bonusType; }
+    void setBonusType(BattleCity::BonusType type) { m_bonusType = type; update(); }
+
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+
+private:
+    BattleCity::BonusType m_bonusType;
+};
+
 class BCFalcon : public BCDestroyableItem
 {
     Q_OBJECT
 public:
     explicit BCFalcon(BCBoard *parent = 0) :
-        BCDestroyableItem(parent) { }
+        BCDestroyableItem(parent), m_destroyed(false) { setUnitSize(BattleCity::tankUnits); }
 
-    int type() const { return BattleCity::Falcon; }
+    int type() const { return m_destroyed ? BattleCity::FalconDestroyed : BattleCity::Falcon; }
+
+    bool destroyed() const { return m_destroyed; }
+    void setDestroyed(bool destroyed) { m_destroyed = destroyed; update(); }
+
+private:
+    bool m_destroyed;
 };
 
 #endif // BCITEM_H
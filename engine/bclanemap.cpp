@@ -0,0 +1,102 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "bclanemap.h"
+
+static inline int lowestBit(quint32 word)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(word);
+#else
+    int bit = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+static inline int highestBit(quint32 word)
+{
+#ifdef __GNUC__
+    return 31 - __builtin_clz(word);
+#else
+    int bit = 31;
+    while (!(word & 0x80000000u)) {
+        word <<= 1;
+        --bit;
+    }
+    return bit;
+#endif
+}
+
+void BCLaneMap::resize(int gridSize)
+{
+    m_gridSize = gridSize;
+    m_words = (gridSize + 31) / 32;
+    m_rows.fill(0, gridSize * m_words);
+    m_columns.fill(0, gridSize * m_words);
+}
+
+void BCLaneMap::set(int row, int column, bool occupied)
+{
+    quint32 &rowWord = m_rows[row * m_words + column / 32];
+    quint32 &columnWord = m_columns[column * m_words + row / 32];
+    if (occupied) {
+        rowWord |= 1u << (column % 32);
+        columnWord |= 1u << (row % 32);
+    } else {
+        rowWord &= ~(1u << (column % 32));
+        columnWord &= ~(1u << (row % 32));
+    }
+}
+
+int BCLaneMap::nextInRow(int row, int column, bool forward) const
+{
+    if (row < 0 || row >= m_gridSize)
+        return -1;
+    return scan(m_rows.constData() + row * m_words, column, forward);
+}
+
+int BCLaneMap::nextInColumn(int column, int row, bool forward) const
+{
+    if (column < 0 || column >= m_gridSize)
+        return -1;
+    return scan(m_columns.constData() + column * m_words, row, forward);
+}
+
+int BCLaneMap::scan(const quint32 *bits, int from, bool forward) const
+{
+    if (from < 0 || from >= m_gridSize)
+        return -1;
+    int word = from / 32;
+    if (forward) {
+        quint32 value = bits[word] & (~0u << (from % 32));
+        while (!value) {
+            if (++word == m_words)
+                return -1;
+            value = bits[word];
+        }
+        return word * 32 + lowestBit(value);
+    }
+    quint32 value = bits[word] & (~0u >> (31 - from % 32));
+    while (!value) {
+        if (--word < 0)
+            return -1;
+        value = bits[word];
+    }
+    return word * 32 + highestBit(value);
+}
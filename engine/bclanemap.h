@@ -0,0 +1,50 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCLANEMAP_H
+#define BCLANEMAP_H
+
+#include <QVector>
+
+// Occupancy of the tile grid as one bitset per row and one per column, so
+// finding the first occupied cell of a lane takes a few word operations.
+class BCLaneMap
+{
+public:
+    BCLaneMap() : m_gridSize(0), m_words(0) { }
+
+    void resize(int gridSize);
+    int gridSize() const { return m_gridSize; }
+
+    void set(int row, int column, bool occupied);
+    bool isSet(int row, int column) const
+    { return m_rows.at(row * m_words + column / 32) & (1u << (column % 32)); }
+
+    // First occupied column of the row from the column on, towards higher
+    // columns when forward is set, or -1.
+    int nextInRow(int row, int column, bool forward) const;
+    int nextInColumn(int column, int row, bool forward) const;
+
+private:
+    int scan(const quint32 *bits, int from, bool forward) const;
+
+    int m_gridSize;
+    int m_words;
+    QVector<quint32> m_rows;      // m_words per row, bit per column
+    QVector<quint32> m_columns;   // m_words per column, bit per row
+};
+
+#endif // BCLANEMAP_H
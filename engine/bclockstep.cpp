@@ -0,0 +1,264 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <string.h>
+
+#include <QUdpSocket>
+#include <QTimer>
+#include <QDataStream>
+
+#include "bclockstep.h"
+
+static const quint32 BC_LOCKSTEP_MAGIC = 0x42434c53;
+static const quint32 noRollback = 0xffffffff;
+
+BCLockstepSession::BCLockstepSession(BCBoard *board, int localPlayer, QObject *parent) :
+    QObject(parent),
+    m_board(board),
+    m_socket(new QUdpSocket(this)),
+    m_timer(new QTimer(this)),
+    m_localPlayer(localPlayer),
+    m_inputDelay(3),
+    m_tick(0),
+    m_rollbackTick(noRollback),
+    m_verifiedTick(0),
+    m_verifiedHash(0),
+    m_bytesSent(0),
+    m_packetLoss(0),
+    m_lossRandom(1)
+{
+    memset(m_frames, 0, sizeof(m_frames));
+    memset(m_usedFrames, 0, sizeof(m_usedFrames));
+    for (int i = 0; i < BCBoard::maxPlayers; ++i)
+        m_confirmed[i] = m_inputDelay;
+
+    m_timer->setInterval(BattleCity::tickInterval);
+    connect(m_timer, SIGNAL(timeout()), SLOT(tick()));
+    connect(m_socket, SIGNAL(readyRead()), SLOT(readPendingDatagrams()));
+}
+
+bool BCLockstepSession::bind(const QHostAddress &address, quint16 port)
+{
+    return m_socket->bind(address, port);
+}
+
+void BCLockstepSession::addPeer(const QHostAddress &address, quint16 port, int player)
+{
+    if (player < 0 || player >= BCBoard::maxPlayers || player == m_localPlayer)
+        return;
+    Peer peer;
+    peer.address = address;
+    peer.port = port;
+    peer.player = player;
+    peer.ack = 0;
+    m_peers << peer;
+}
+
+void BCLockstepSession::setInputDelay(int ticks)
+{
+    if (m_timer->isActive())
+        return;
+    m_inputDelay = qBound(0, ticks, int(MaxInputDelay));
+    for (int i = 0; i < BCBoard::maxPlayers; ++i)
+        m_confirmed[i] = m_inputDelay;
+}
+
+void BCLockstepSession::start()
+{
+    int playersCount = m_localPlayer + 1;
+    foreach (const Peer &peer, m_peers)
+        playersCount = qMax(playersCount, peer.player + 1);
+    m_board->setPlayersCount(playersCount);
+    m_board->setAutoTick(false);
+
+    for (int i = 0; i < playersCount; ++i) {
+        BCController *controller = m_board->playerController(i);
+        controller->clearKeyMapping();
+        if (i == m_localPlayer)
+            controller->setDefaultKeyMapping();
+    }
+
+    m_timer->start();
+}
+
+void BCLockstepSession::stop()
+{
+    m_timer->stop();
+    m_board->setAutoTick(true);
+}
+
+BCInputFrame BCLockstepSession::frame(int player, quint32 tick) const
+{
+    const quint32 confirmed = m_confirmed[player];
+    if (tick < confirmed)
+        return m_frames[player][tick % Window];
+    // Not there yet: predict that the player keeps doing what they did last.
+    return confirmed > 0 ? m_frames[player][(confirmed - 1) % Window] : 0;
+}
+
+quint32 BCLockstepSession::confirmedTick() const
+{
+    quint32 confirmed = m_confirmed[m_localPlayer];
+    foreach (const Peer &peer, m_peers)
+        confirmed = qMin(confirmed, m_confirmed[peer.player]);
+    return confirmed;
+}
+
+void BCLockstepSession::tick()
+{
+    BCController *controller = m_board->playerController(m_localPlayer);
+    BCInputCommand command;
+    while (controller->takeCommand(&command))
+        m_localInput.apply(command);
+
+    // Local input is scheduled inputDelay ticks ahead, so on a healthy link
+    // it reaches the peers before they need it and no rollback happens.
+    quint32 &local = m_confirmed[m_localPlayer];
+    if (local <= m_tick + m_inputDelay) {
+        m_frames[m_localPlayer][local % Window] = m_localInput.frame();
+        m_localInput.clearPressed();
+        ++local;
+    }
+
+    sendInputs();
+    rollback();
+    if (m_tick < confirmedTick() + MaxPrediction)
+        simulate(m_tick++);
+    verify();
+}
+
+void BCLockstepSession::simulate(quint32 tick)
+{
+    m_snapshots[tick % Window] = m_board->saveState();
+
+    BCInputFrame frames[BCBoard::maxPlayers];
+    for (int i = 0; i < BCBoard::maxPlayers; ++i) {
+        frames[i] = frame(i, tick);
+        m_usedFrames[tick % Window][i] = frames[i];
+    }
+    m_board->step(frames);
+}
+
+void BCLockstepSession::rollback()
+{
+    if (m_rollbackTick >= m_tick) {
+        m_rollbackTick = noRollback;
+        return;
+    }
+    m_board->restoreState(m_snapshots[m_rollbackTick % Window]);
+    for (quint32 tick = m_rollbackTick; tick < m_tick; ++tick)
+        simulate(tick);
+    m_rollbackTick = noRollback;
+}
+
+void BCLockstepSession::verify()
+{
+    // Ticks below the confirmed one were simulated with final input only, so
+    // the snapshots taken before them will not change any more.
+    const quint32 verified = qMin(confirmedTick(), m_tick - 1);
+    if (m_tick == 0 || verified == m_verifiedTick)
+        return;
+    m_verifiedTick = verified;
+    m_verifiedHash = m_snapshots[m_verifiedTick % Window].hash();
+}
+
+void BCLockstepSession::sendInputs()
+{
+    const quint32 local = m_confirmed[m_localPlayer];
+    for (int i = 0; i < m_peers.count(); ++i) {
+        const Peer &peer = m_peers[i];
+        // Resend everything the peer has not acknowledged yet, this covers
+        // lost datagrams without a retransmission timer. The peer takes
+        // frames in order only, so the packet always starts at its ack.
+        const quint32 first = qMin(peer.ack, local);
+        const quint8 count = qMin(local - first, quint32(MaxFramesPerPacket));
+
+        QByteArray datagram;
+        QDataStream out(&datagram, QIODevice::WriteOnly);
+        out << BC_LOCKSTEP_MAGIC << quint8(m_localPlayer) << m_confirmed[peer.player]
+            << m_verifiedTick << m_verifiedHash << first << count;
+        for (quint32 tick = first; tick < first + count; ++tick)
+            out << m_frames[m_localPlayer][tick % Window];
+
+        if (m_packetLoss) {
+            m_lossRandom = m_lossRandom * 1103515245u + 12345u;
+            if (int((m_lossRandom >> 16) % 100) < m_packetLoss)
+                continue;
+        }
+        m_bytesSent += m_socket->writeDatagram(datagram, peer.address, peer.port);
+    }
+}
+
+void BCLockstepSession::readPendingDatagrams()
+{
+    while (m_socket->hasPendingDatagrams()) {
+        QByteArray datagram;
+        QHostAddress address;
+        quint16 port = 0;
+        datagram.resize(int(m_socket->pendingDatagramSize()));
+        m_socket->readDatagram(datagram.data(), datagram.size(), &address, &port);
+
+        QDataStream in(datagram);
+        quint32 magic = 0;
+        quint8 player = 0;
+        quint32 ack = 0;
+        quint32 hashTick = 0;
+        quint32 hash = 0;
+        quint32 first = 0;
+        quint8 count = 0;
+        in >> magic >> player >> ack >> hashTick >> hash >> first >> count;
+        if (magic != BC_LOCKSTEP_MAGIC || in.status() != QDataStream::Ok || player == m_localPlayer)
+            continue;
+
+        // Only the configured peer of a player speaks for it.
+        Peer *peer = 0;
+        for (int i = 0; i < m_peers.count(); ++i) {
+            if (m_peers[i].player == player && m_peers[i].port == port && m_peers[i].address == address) {
+                peer = &m_peers[i];
+                break;
+            }
+        }
+        if (!peer)
+            continue;
+        peer->ack = qMax(peer->ack, ack);
+
+        quint32 &confirmed = m_confirmed[player];
+        for (quint32 tick = first; tick < first + count; ++tick) {
+            BCInputFrame frame = 0;
+            in >> frame;
+            if (in.status() != QDataStream::Ok || tick > confirmed)
+                break;
+            if (tick < confirmed)
+                continue;
+            m_frames[player][tick % Window] = frame;
+            ++confirmed;
+            if (tick < m_tick && m_usedFrames[tick % Window][player] != frame)
+                m_rollbackTick = qMin(m_rollbackTick, tick);
+        }
+
+        if (hash != 0)
+            checkHash(hashTick, hash);
+    }
+}
+
+void BCLockstepSession::checkHash(quint32 tick, quint32 hash)
+{
+    // Only ticks whose snapshot is final and still kept can be compared.
+    if (tick > m_verifiedTick || m_verifiedTick - tick >= Window - MaxPrediction)
+        return;
+    const quint32 localHash = tick == m_verifiedTick ? m_verifiedHash : m_snapshots[tick % Window].hash();
+    if (localHash != hash)
+        emit desyncDetected(tick);
+}
@@ -0,0 +1,107 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCLOCKSTEP_H
+#define BCLOCKSTEP_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QList>
+
+#include "bcboard.h"
+
+class QUdpSocket;
+class QTimer;
+
+// Lockstep session: peers exchange only their per-tick input frames over UDP,
+// each peer runs the same simulation. Remote input that is not there yet is
+// predicted, and the board is rolled back and re-simulated when it arrives
+// and differs from the prediction. State hashes of confirmed ticks are
+// exchanged to detect desyncs.
+class BCLockstepSession : public QObject
+{
+    Q_OBJECT
+public:
+    enum { Window = 64, MaxPrediction = 16, MaxInputDelay = 8, MaxFramesPerPacket = 32 };
+
+    BCLockstepSession(BCBoard *board, int localPlayer, QObject *parent = 0);
+
+    bool bind(const QHostAddress &address, quint16 port);
+    void addPeer(const QHostAddress &address, quint16 port, int player);
+
+    void setInputDelay(int ticks);
+    int inputDelay() const { return m_inputDelay; }
+
+    void start();
+    void stop();
+
+    quint32 currentTick() const { return m_tick; }
+    quint64 bytesSent() const { return m_bytesSent; }
+
+    // Drops that percentage of the datagrams to send, to test recovery.
+    void setPacketLoss(int percent) { m_packetLoss = qBound(0, percent, 100); }
+
+signals:
+    void desyncDetected(quint32 tick);
+
+private slots:
+    void tick();
+    void readPendingDatagrams();
+
+private:
+    struct Peer
+    {
+        QHostAddress address;
+        quint16 port;
+        int player;
+        quint32 ack;
+    };
+
+    BCInputFrame frame(int player, quint32 tick) const;
+    quint32 confirmedTick() const;
+    void simulate(quint32 tick);
+    void rollback();
+    void verify();
+    void sendInputs();
+    void checkHash(quint32 tick, quint32 hash);
+
+private:
+    BCBoard *m_board;
+    QUdpSocket *m_socket;
+    QTimer *m_timer;
+
+    int m_localPlayer;
+    int m_inputDelay;
+    BCInputState m_localInput;
+
+    QList<Peer> m_peers;
+
+    BCInputFrame m_frames[BCBoard::maxPlayers][Window];
+    quint32 m_confirmed[BCBoard::maxPlayers];
+    BCInputFrame m_usedFrames[Window][BCBoard::maxPlayers];
+    BCBoardState m_snapshots[Window];
+
+    quint32 m_tick;
+    quint32 m_rollbackTick;
+    quint32 m_verifiedTick;
+    quint32 m_verifiedHash;
+
+    quint64 m_bytesSent;
+    int m_packetLoss;
+    quint32 m_lossRandom;
+};
+
+#endif // BCLOCKSTEP_H
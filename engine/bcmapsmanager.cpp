@@ -14,6 +14,7 @@
 ****************************************************************************/
 
 #include <QDir>
+#include <QBuffer>
 #include <QPainter>
 #include <QStyleOptionGraphicsItem>
 #include <QGraphicsScene>
@@ -22,6 +23,8 @@
 
 #include "bcmapsmanager.h"
 #include "bcboard.h"
+#include "bcstagegenerator.h"
+#include "bcmapvalidator.h"
 
 static QString BC_MAP_EXT = "bc";
 static QString BC_STAGE = "stage";
@@ -29,7 +32,8 @@ static QString BC_STAGE = "stage";
 BCMapsManager::BCMapsManager(QObject *parent) :
     QObject(parent),
     m_mapsDir(qApp->applicationDirPath() + "/maps"),
-    m_lastStage(0)
+    m_lastStage(0),
+    m_currentMap(-1)
 {
     QDir mapsDir(m_mapsDir);
     if (!mapsDir.exists(m_mapsDir))
@@ -50,24 +54,44 @@ void BCMapsManager::reloadMapsList()    //TODO: optimaze this later
     m_mapsList = dir.entryList(QStringList() << QString("*.%1").arg(BC_MAP_EXT));
     qSort(m_mapsList.begin(), m_mapsList.end(), lessThen);
     m_lastStage = QString(m_mapsList.last()).remove(BC_STAGE).remove('.' + BC_MAP_EXT).toULongLong();
+
+    QStringList fileNames;
+    foreach (const QString &map, m_mapsList)
+        fileNames << dir.filePath(map);
+    m_prefetcher.setFileNames(fileNames);
     emit mapsListChanged();
 }
 
 bool BCMapsManager::saveMap(BCBoard *board)
 {
-    QFile file(QString("%1/%2%3.%4").arg(m_mapsDir).arg(BC_STAGE).arg(m_lastStage + 1).arg(BC_MAP_EXT));
-    if (!file.open(QIODevice::WriteOnly))
-        return false;
-    QDataStream out(&file);
+    const QString fileName = QString("%1/%2%3.%4").arg(m_mapsDir).arg(BC_STAGE).arg(m_lastStage + 1).arg(BC_MAP_EXT);
+    QByteArray map;
+    QBuffer buffer(&map);
+    buffer.open(QIODevice::ReadWrite);
+    QDataStream out(&buffer);
     out << (*board);
+    buffer.seek(0);
+    BCMapReport report = BCMapValidator::validate(&buffer);
+    if (!report.valid()) {
+        report.fileName = fileName;
+        emit mapRejected(report.toString());
+        return false;
+    }
 
-    QPixmap pixmap(board->implicitWidth(), board->implicitHeight());
-    QPainter painter(&pixmap);
-    const bool gridVisible = board->gridVisible();
-    board->setGridVisible(false);
-    board->scene()->render(&painter, QRect(0, 0, board->implicitWidth(), board->implicitHeight()),
-                           QRect(5, 5, board->implicitWidth(), board->implicitHeight()));
-    board->setGridVisible(gridVisible);
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(map) != map.size())
+        return false;
+
+    // Generated stages are saved from boards out of any scene.
+    if (board->scene()) {
+        QPixmap pixmap(board->implicitWidth(), board->implicitHeight());
+        QPainter painter(&pixmap);
+        const bool gridVisible = board->gridVisible();
+        board->setGridVisible(false);
+        board->scene()->render(&painter, QRect(0, 0, board->implicitWidth(), board->implicitHeight()),
+                               QRect(5, 5, board->implicitWidth(), board->implicitHeight()));
+        board->setGridVisible(gridVisible);
+    }
 
     QMetaObject::invokeMethod(const_cast<BCMapsManager *>(this), "reloadMapsList");
     emit mapSaved();
@@ -76,11 +100,56 @@ bool BCMapsManager::saveMap(BCBoard *board)
 
 bool BCMapsManager::loadMap(const QString &mapName, BCBoard *board)
 {
-    QFile file(QString("%1/%2").arg(m_mapsDir).arg(mapName));
-    if (!file.open(QIODevice::ReadOnly))
+    const int index = m_mapsList.indexOf(mapName);
+    if (index < 0)
+        return false;
+    const BCStage stage = m_prefetcher.take(index);
+    if (stage.isNull())
         return false;
-    QDataStream in(&file);
-    in >> (*board);
+    board->loadStage(stage);
+    m_currentMap = index;
+    m_prefetcher.prefetch(index + 1);
     emit mapLoaded();
     return true;
 }
+
+bool BCMapsManager::loadNextMap(BCBoard *board)
+{
+    if (m_currentMap + 1 >= m_mapsList.count())
+        return false;
+    return loadMap(m_mapsList[m_currentMap + 1], board);
+}
+
+bool BCMapsManager::generateMap(quint32 seed, BCBoard *board)
+{
+    BCStageGenerator generator(board->boardSize(), seed);
+    const QByteArray tiles = generator.generate();
+    if (tiles.isEmpty())
+        return false;
+    board->loadTiles(generator.boardSize(), tiles);
+    emit mapLoaded();
+    return saveMap(board);
+}
+
+BCStage BCMapsManager::readStage(const QString &fileName)
+{
+    BCStage stage;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return stage;
+    BCMapReport report = BCMapValidator::validate(&file, BCMapValidator::defaultPlayers, &stage);
+    if (!report.valid()) {
+        report.fileName = fileName;
+        qWarning("Invalid map %s", qPrintable(report.toString()));
+    }
+    return stage;
+}
+
+bool BCMapsManager::readMap(const QString &fileName, BCBoard *board)
+{
+    const BCStage stage = readStage(fileName);
+    if (stage.isNull())
+        return false;
+    board->loadStage(stage);
+    return true;
+}
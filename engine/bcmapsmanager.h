@@ -20,6 +20,8 @@
 #include <QObject>
 #include <QStringList>
 
+#include "bcstageprefetcher.h"
+
 class BCBoard;
 
 class BCMapsManager : public QObject
@@ -32,13 +34,28 @@ public:
 
     QStringList maps() const { return m_mapsList; }
 
+    // Saves the board as the next stage, unless BCMapValidator would reject
+    // it on loading: mapRejected() then tells why.
     Q_INVOKABLE bool saveMap(BCBoard *board);
+    // The stages after the loaded one are read in the background, so that
+    // loading them next takes no file access.
     Q_INVOKABLE bool loadMap(const QString &mapName, BCBoard *board);
+    Q_INVOKABLE bool loadNextMap(BCBoard *board);
+    // Makes a stage of the board size from the seed, loads it into the board
+    // and saves it as the next stage.
+    Q_INVOKABLE bool generateMap(quint32 seed, BCBoard *board);
+
+    // Reads a map file of any location into the board, unless
+    // BCMapValidator rejects it.
+    static bool readMap(const QString &fileName, BCBoard *board);
+    // Decodes a map file in any thread, a null stage if it is invalid.
+    static BCStage readStage(const QString &fileName);
 
 signals:
     void mapsListChanged();
     void mapSaved();
     void mapLoaded();
+    void mapRejected(const QString &reason);
 
 private slots:
     void reloadMapsList();
@@ -47,6 +64,8 @@ private:
     QString m_mapsDir;
     QStringList m_mapsList;
     quint64 m_lastStage;
+    int m_currentMap;
+    BCStagePrefetcher m_prefetcher;
 };
 
 #endif // BCMAPSMANAGER_H
@@ -0,0 +1,195 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QDataStream>
+#include <QFile>
+#include <QtConcurrentMap>
+
+#include "bcmapvalidator.h"
+#include "bcboard.h"
+#include "bcstagegenerator.h"
+
+static const char *errorNames[] = {
+    "ok", "unreadable", "truncated", "bad board size", "bad tile", "bad roster", "bad waves",
+    "trailing data", "spawn blocked", "falcon unreachable"
+};
+
+QString BCMapReport::toString() const
+{
+    QString line = QString("%1: %2").arg(fileName).arg(errorNames[error]);
+    if (!message.isEmpty())
+        line += ", " + message;
+    return line;
+}
+
+static BCMapReport failure(BCMapReport::Error error, const QString &message = QString())
+{
+    BCMapReport report;
+    report.error = error;
+    report.message = message;
+    return report;
+}
+
+static bool isTile(int type)
+{
+    switch (type) {
+    case BattleCity::Ground:
+    case BattleCity::BricksWall:
+    case BattleCity::ConcreteWall:
+    case BattleCity::Ice:
+    case BattleCity::Camouflage:
+    case BattleCity::Water:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool blockClear(const QByteArray &tiles, int gridSize, int row, int column)
+{
+    for (int r = 2 * row; r < 2 * row + 2; ++r) {
+        for (int c = 2 * column; c < 2 * column + 2; ++c) {
+            if (BCTerrain::flags(tiles.at(r * gridSize + c)) & BCTerrain::BlocksTanks)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Whether the spawn block at the board cell overlaps the falcon or the
+// bricks the generator lays around it.
+static bool onFalcon(int boardSize, int row, int column)
+{
+    const QPoint falcon = BCBoard::falconCell(boardSize);
+    return 2 * row + 1 >= 2 * falcon.y() - 1
+            && 2 * column + 1 >= 2 * falcon.x() - 1 && 2 * column <= 2 * falcon.x() + 2;
+}
+
+BCMapReport BCMapValidator::validate(QIODevice *device, int players, BCStage *stage)
+{
+    QDataStream in(device);
+    int boardSize = 0;
+    in >> boardSize;
+    if (in.status() != QDataStream::Ok)
+        return failure(BCMapReport::Truncated, "no header");
+    if (boardSize < minBoardSize || boardSize > maxBoardSize)
+        return failure(BCMapReport::BadBoardSize, QString::number(boardSize));
+
+    const int gridSize = 2 * boardSize;
+    QByteArray tiles(gridSize * gridSize, 0);
+    for (int i = 0; i < tiles.size(); ++i) {
+        int type = -1;
+        in >> type;
+        if (in.status() != QDataStream::Ok)
+            return failure(BCMapReport::Truncated, QString("%1 of %2 tiles").arg(i).arg(tiles.size()));
+        if (!isTile(type))
+            return failure(BCMapReport::BadTile, QString("type %1 at %2, %3").arg(type).arg(i / gridSize).arg(i % gridSize));
+        tiles[i] = char(type - BattleCity::Ground);
+    }
+
+    int marker = -1;
+    in >> marker;
+    const bool legacy = marker != BCBoard::rosterMagic;
+    int count = 20;
+    if (!legacy)
+        in >> count;
+    if (in.status() != QDataStream::Ok)
+        return failure(BCMapReport::Truncated, "no roster");
+    if (count < 0 || count > maxRoster)
+        return failure(BCMapReport::BadRoster, QString("%1 tanks").arg(count));
+    BCSpawnScheduler spawner;
+    spawner.setRosterCount(count);
+    for (int index = 0; index < count; ++index) {
+        int type = legacy && index == 0 ? marker : -1;
+        bool bonus = false;
+        if (!legacy || index)
+            in >> type;
+        in >> bonus;
+        if (in.status() != QDataStream::Ok)
+            return failure(BCMapReport::Truncated, QString("%1 of %2 tanks").arg(index).arg(count));
+        if (type < BattleCity::Basic || type > BattleCity::Armor)
+            return failure(BCMapReport::BadRoster, QString("type %1 at %2").arg(type).arg(index));
+        spawner.setEntry(index, BattleCity::TankType(type), bonus);
+    }
+
+    QList<BCSpawnScheduler::Wave> waves;
+    bool endless = false;
+    if (!legacy) {
+        int wavesCount = 0;
+        in >> wavesCount;
+        if (wavesCount < 0 || wavesCount > maxWaves)
+            return failure(BCMapReport::BadWaves, QString("%1 waves").arg(wavesCount));
+        for (int i = 0; i < wavesCount; ++i) {
+            BCSpawnScheduler::Wave wave;
+            in >> wave.count >> wave.maxActive >> wave.interval;
+            if (in.status() != QDataStream::Ok)
+                return failure(BCMapReport::Truncated, QString("%1 of %2 waves").arg(i).arg(wavesCount));
+            if (wave.count < 0 || wave.maxActive < 1 || wave.maxActive > BCBoard::maxActiveEnemies || wave.interval < 0)
+                return failure(BCMapReport::BadWaves, QString("wave %1").arg(i));
+            waves << wave;
+        }
+        in >> endless;
+    }
+    if (in.status() != QDataStream::Ok)
+        return failure(BCMapReport::Truncated, "no waves");
+    if (!in.atEnd())
+        return failure(BCMapReport::TrailingData);
+
+    for (int i = 0; i < BCBoard::enemySpawnPoints; ++i) {
+        if (onFalcon(boardSize, 0, BCBoard::enemySpawnColumn(boardSize, i)))
+            return failure(BCMapReport::SpawnBlocked, QString("enemy %1 on the falcon").arg(i));
+    }
+    for (int i = 0; i < BCBoard::maxPlayers; ++i) {
+        if (onFalcon(boardSize, boardSize - 1, BCBoard::playerSpawnColumn(boardSize, i)))
+            return failure(BCMapReport::SpawnBlocked, QString("player %1 on the falcon").arg(i + 1));
+    }
+    for (int i = 0; i < BCBoard::enemySpawnPoints; ++i) {
+        if (!blockClear(tiles, gridSize, 0, BCBoard::enemySpawnColumn(boardSize, i)))
+            return failure(BCMapReport::SpawnBlocked, QString("enemy %1").arg(i));
+    }
+    for (int i = 0; i < players; ++i) {
+        if (!blockClear(tiles, gridSize, boardSize - 1, BCBoard::playerSpawnColumn(boardSize, i)))
+            return failure(BCMapReport::SpawnBlocked, QString("player %1").arg(i + 1));
+    }
+    if (!BCStageGenerator::playable(tiles, boardSize, players))
+        return failure(BCMapReport::FalconUnreachable);
+
+    if (stage) {
+        stage->boardSize = boardSize;
+        stage->tiles = tiles;
+        stage->spawner = spawner;
+        stage->spawner.setWaves(waves);
+        stage->spawner.setEndless(endless);
+    }
+
+    BCMapReport report;
+    report.boardSize = boardSize;
+    return report;
+}
+
+BCMapReport BCMapValidator::validateFile(const QString &fileName)
+{
+    QFile file(fileName);
+    BCMapReport report = file.open(QIODevice::ReadOnly) ? validate(&file)
+                                                        : failure(BCMapReport::Unreadable, file.errorString());
+    report.fileName = fileName;
+    return report;
+}
+
+QList<BCMapReport> BCMapValidator::validateFiles(const QStringList &fileNames)
+{
+    return QtConcurrent::blockingMapped<QList<BCMapReport> >(fileNames, validateFile);
+}
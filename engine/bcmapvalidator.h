@@ -0,0 +1,66 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+
+#ifndef BCMAPVALIDATOR_H
+#define BCMAPVALIDATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+class QIODevice;
+struct BCStage;
+
+struct BCMapReport
+{
+    enum Error { NoError, Unreadable, Truncated, BadBoardSize, BadTile, BadRoster, BadWaves,
+                 TrailingData, SpawnBlocked, FalconUnreachable };
+
+    BCMapReport() : error(NoError), boardSize(0) { }
+
+    bool valid() const { return error == NoError; }
+    QString toString() const;
+
+    QString fileName;
+    Error error;
+    QString message;
+    int boardSize;
+};
+
+// Checks a map file the way operator >> (QDataStream &, BCBoard &) reads it,
+// before any board sees it: board size, tile types, roster and waves, then
+// that no spawn point sits on the falcon or its wall, that the spawn points
+// of the enemies and of the first players are clear and that they can reach
+// the falcon.
+class BCMapValidator
+{
+public:
+    static const int minBoardSize = 13;     // player spawns go 6 columns either side of the falcon
+    static const int maxBoardSize = 64;
+    static const int maxRoster = 0xffff;
+    static const int maxWaves = 0xff;
+    static const int defaultPlayers = 2;
+
+    // A valid map is also decoded into the stage, if there is one.
+    static BCMapReport validate(QIODevice *device, int players = defaultPlayers, BCStage *stage = 0);
+    static BCMapReport validateFile(const QString &fileName);
+
+    // Files are checked in parallel on the global thread pool.
+    static QList<BCMapReport> validateFiles(const QStringList &fileNames);
+};
+
+#endif // BCMAPVALIDATOR_H
@@ -0,0 +1,295 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QDataStream>
+#include <QIODevice>
+
+#include "bcsnapshot.h"
+#include "bcboard.h"
+#include "bctank.h"
+
+enum ActorFields {
+    TypeField = 0x01,
+    StateField = 0x02,
+    SmallMoveField = 0x04,
+    PositionField = 0x08
+};
+
+static inline quint16 quantize(int units)
+{
+    static const int step = BattleCity::tankUnits / BCSnapshot::positionScale;
+    return quint16(qBound(0, (units + step / 2) / step, 0xffff));
+}
+
+static BCSnapshot::Actor actor(const BCMovableItem *item, quint8 type)
+{
+    BCSnapshot::Actor actor;
+    actor.type = type;
+    actor.state = quint8(item->direction()) | (item->isVisible() ? 0x04 : 0);
+    actor.x = quantize(item->unitRect().x());
+    actor.y = quantize(item->unitRect().y());
+    return actor;
+}
+
+static void captureTank(BCSnapshot &snapshot, const BCAbstractTank *tank)
+{
+    BCSnapshot::Actor tankActor = actor(tank, quint8(tank->type() - BattleCity::Ground));
+    if (tank->type() == BattleCity::Player) {
+        tankActor.state |= static_cast<const BCPlayerTank *>(tank)->stars() << 4;
+    } else if (static_cast<const BCEnemyTank *>(tank)->bonus()) {
+        tankActor.state |= 0x08;
+    }
+    snapshot.actors << tankActor;
+
+    for (int i = 0; i < BCSnapshot::projectileSlots; ++i) {
+        const BCProjectile *projectile = tank->projectile(i);
+        snapshot.actors << (projectile ? actor(projectile, BCSnapshot::projectileType) : BCSnapshot::Actor());
+    }
+}
+
+BCSnapshot BCSnapshot::capture(const BCBoard *board)
+{
+    BCSnapshot snapshot;
+    snapshot.tick = board->currentTick();
+    snapshot.gridSize = board->boardSize() * 2;
+
+    snapshot.tiles.resize(snapshot.gridSize * snapshot.gridSize);
+    char *tiles = snapshot.tiles.data();
+    for (int row = 0; row < snapshot.gridSize; ++row) {
+        for (int column = 0; column < snapshot.gridSize; ++column) {
+            const BCItem *obstacle = board->obstacle(row, column);
+            *tiles++ = obstacle ? char(obstacle->type() - BattleCity::Ground) : 0;
+        }
+    }
+
+    snapshot.actors.reserve((board->playersCount() + BCBoard::maxActiveEnemies) * (1 + projectileSlots) + 2);
+    for (int i = 0; i < board->playersCount(); ++i)
+        captureTank(snapshot, board->playerTank(i));
+    for (int i = 0; i < BCBoard::maxActiveEnemies; ++i) {
+        if (board->enemyTank(i))
+            captureTank(snapshot, board->enemyTank(i));
+        else
+            snapshot.actors.insert(snapshot.actors.end(), 1 + projectileSlots, BCSnapshot::Actor());
+    }
+
+    const BCBonus *bonus = board->bonus();
+    Actor bonusActor;
+    bonusActor.type = quint8(BattleCity::Bonus - BattleCity::Ground);
+    bonusActor.state = (bonus->isVisible() ? 0x04 : 0) | bonus->bonusType() << 4;
+    bonusActor.x = quantize(bonus->unitRect().x());
+    bonusActor.y = quantize(bonus->unitRect().y());
+    snapshot.actors << bonusActor;
+
+    const BCFalcon *falcon = board->falcon();
+    Actor falconActor;
+    falconActor.type = quint8(falcon->type() - BattleCity::Ground);
+    falconActor.state = 0x04;
+    falconActor.x = quantize(falcon->unitRect().x());
+    falconActor.y = quantize(falcon->unitRect().y());
+    snapshot.actors << falconActor;
+    return snapshot;
+}
+
+QByteArray BCSnapshotEncoder::encode(const BCSnapshot &snapshot)
+{
+    static const BCSnapshot empty;
+    const BCSnapshot &base = m_hasBaseline ? m_baseline : empty;
+
+    QByteArray packet;
+    QDataStream out(&packet, QIODevice::WriteOnly);
+    out << snapshot.tick << m_hasBaseline;
+    if (m_hasBaseline)
+        out << base.tick;
+    out << snapshot.gridSize;
+
+    const bool sameGrid = base.gridSize == snapshot.gridSize;
+    QVector<quint16> changed;
+    for (int i = 0; i < snapshot.tiles.size(); ++i) {
+        const char baseType = sameGrid ? base.tiles.at(i) : 0;
+        if (snapshot.tiles.at(i) != baseType)
+            changed << quint16(i);
+    }
+    out << quint16(changed.count());
+    foreach (quint16 index, changed)
+        out << index << quint8(snapshot.tiles.at(index));
+
+    const int count = snapshot.actors.count();
+    QByteArray mask((count + 7) / 8, 0);
+    for (int i = 0; i < count; ++i) {
+        if (i >= base.actors.count() || snapshot.actors[i] != base.actors[i])
+            mask[i / 8] = mask[i / 8] | (1 << (i % 8));
+    }
+    out << quint8(count);
+    out.writeRawData(mask.constData(), mask.size());
+
+    for (int i = 0; i < count; ++i) {
+        if (!(mask[i / 8] & (1 << (i % 8))))
+            continue;
+        const BCSnapshot::Actor &current = snapshot.actors[i];
+        const BCSnapshot::Actor previous = i < base.actors.count() ? base.actors[i] : BCSnapshot::Actor();
+        const int dx = int(current.x) - int(previous.x);
+        const int dy = int(current.y) - int(previous.y);
+
+        quint8 fields = 0;
+        if (current.type != previous.type)
+            fields |= TypeField;
+        if (current.state != previous.state)
+            fields |= StateField;
+        if (dx || dy)
+            fields |= (qAbs(dx) < 128 && qAbs(dy) < 128) ? SmallMoveField : PositionField;
+
+        out << fields;
+        if (fields & TypeField)
+            out << current.type;
+        if (fields & StateField)
+            out << current.state;
+        if (fields & SmallMoveField)
+            out << qint8(dx) << qint8(dy);
+        if (fields & PositionField)
+            out << current.x << current.y;
+    }
+
+    m_pending.insert(snapshot.tick, snapshot);
+    while (m_pending.count() > MaxPending)
+        m_pending.erase(m_pending.begin());
+    return packet;
+}
+
+void BCSnapshotEncoder::acknowledge(quint32 tick)
+{
+    QMap<quint32, BCSnapshot>::iterator it = m_pending.find(tick);
+    if (it == m_pending.end())
+        return;
+    m_baseline = *it;
+    m_hasBaseline = true;
+    while (!m_pending.isEmpty() && m_pending.begin().key() <= tick)
+        m_pending.erase(m_pending.begin());
+}
+
+void BCSnapshotEncoder::reset()
+{
+    m_pending.clear();
+    m_baseline = BCSnapshot();
+    m_hasBaseline = false;
+}
+
+bool BCSnapshotDecoder::decode(const QByteArray &packet, BCSnapshot *snapshot)
+{
+    QDataStream in(packet);
+    quint32 tick = 0;
+    bool hasBaseline = false;
+    quint32 baseTick = 0;
+    in >> tick >> hasBaseline;
+    if (hasBaseline)
+        in >> baseTick;
+
+    BCSnapshot base;
+    if (hasBaseline) {
+        QMap<quint32, BCSnapshot>::const_iterator it = m_history.constFind(baseTick);
+        if (it == m_history.constEnd())
+            return false;
+        base = *it;
+    }
+
+    BCSnapshot result;
+    result.tick = tick;
+    in >> result.gridSize;
+    result.tiles = base.gridSize == result.gridSize ? base.tiles : QByteArray(result.gridSize * result.gridSize, 0);
+
+    quint16 changed = 0;
+    in >> changed;
+    for (quint16 i = 0; i < changed; ++i) {
+        quint16 index = 0;
+        quint8 type = 0;
+        in >> index >> type;
+        if (index >= result.tiles.size())
+            return false;
+        result.tiles[index] = char(type);
+    }
+
+    quint8 count = 0;
+    in >> count;
+    QByteArray mask((count + 7) / 8, 0);
+    in.readRawData(mask.data(), mask.size());
+
+    result.actors = base.actors;
+    result.actors.resize(count);
+    for (int i = 0; i < count; ++i) {
+        if (!(mask[i / 8] & (1 << (i % 8))))
+            continue;
+        BCSnapshot::Actor &actor = result.actors[i];
+        quint8 fields = 0;
+        in >> fields;
+        if (fields & TypeField)
+            in >> actor.type;
+        if (fields & StateField)
+            in >> actor.state;
+        if (fields & SmallMoveField) {
+            qint8 dx = 0;
+            qint8 dy = 0;
+            in >> dx >> dy;
+            actor.x += dx;
+            actor.y += dy;
+        }
+        if (fields & PositionField)
+            in >> actor.x >> actor.y;
+    }
+
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    m_history.insert(tick, result);
+    while (m_history.count() > MaxHistory)
+        m_history.erase(m_history.begin());
+    *snapshot = result;
+    return true;
+}
+
+BCSnapshotRecorder::BCSnapshotRecorder(BCBoard *board, QIODevice *device, QObject *parent) :
+    QObject(parent),
+    m_board(board),
+    m_device(device),
+    m_interval(1),
+    m_autoAcknowledge(!device->isSequential()),
+    m_bytesWritten(0)
+{
+    connect(board, SIGNAL(stepped(quint32)), SLOT(record()));
+    connect(device, SIGNAL(readyRead()), SLOT(readAcknowledgements()));
+}
+
+void BCSnapshotRecorder::record()
+{
+    if (!m_device || !m_device->isWritable() || m_board->currentTick() % m_interval)
+        return;
+
+    const BCSnapshot snapshot = BCSnapshot::capture(m_board);
+    const QByteArray packet = m_encoder.encode(snapshot);
+    QDataStream out(m_device);
+    out << packet;
+    m_bytesWritten += sizeof(quint32) + packet.size();
+
+    if (m_autoAcknowledge)
+        m_encoder.acknowledge(snapshot.tick);
+}
+
+void BCSnapshotRecorder::readAcknowledgements()
+{
+    QDataStream in(m_device);
+    while (m_device->bytesAvailable() >= qint64(sizeof(quint32))) {
+        quint32 tick = 0;
+        in >> tick;
+        m_encoder.acknowledge(tick);
+    }
+}
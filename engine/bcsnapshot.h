@@ -0,0 +1,122 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCSNAPSHOT_H
+#define BCSNAPSHOT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QMap>
+#include <QPointer>
+
+class BCBoard;
+class QIODevice;
+
+// Compact view of the board for spectators: obstacle types of the tile grid
+// and quantized actors (tanks and their projectiles) in fixed slots; empty
+// enemy slots are all zero actors, the power-up and the falcon come last.
+struct BCSnapshot
+{
+    // Actor positions are stored in 1/positionScale of a board cell.
+    static const int positionScale = 16;
+    static const quint8 projectileType = 0xff;
+    static const int projectileSlots = 2;
+
+    struct Actor
+    {
+        Actor() : type(0), state(0), x(0), y(0) { }
+
+        bool operator == (const Actor &other) const
+        { return type == other.type && state == other.state && x == other.x && y == other.y; }
+        bool operator != (const Actor &other) const { return !operator == (other); }
+
+        quint8 type;    // item type relative to BattleCity::Ground, or projectileType
+        quint8 state;   // direction in bits 0-1, visible bit 2, bonus bit 3, stars or power-up in bits 4-6
+        quint16 x;
+        quint16 y;
+    };
+
+    BCSnapshot() : tick(0), gridSize(0) { }
+
+    static BCSnapshot capture(const BCBoard *board);
+
+    quint32 tick;
+    quint16 gridSize;
+    QByteArray tiles;
+    QVector<Actor> actors;
+};
+
+// Encodes snapshots as deltas against the last snapshot acknowledged by the
+// receiver; a full snapshot is a delta against an empty board.
+class BCSnapshotEncoder
+{
+public:
+    enum { MaxPending = 64 };
+
+    BCSnapshotEncoder() : m_hasBaseline(false) { }
+
+    QByteArray encode(const BCSnapshot &snapshot);
+    void acknowledge(quint32 tick);
+    void reset();
+
+private:
+    QMap<quint32, BCSnapshot> m_pending;
+    BCSnapshot m_baseline;
+    bool m_hasBaseline;
+};
+
+class BCSnapshotDecoder
+{
+public:
+    enum { MaxHistory = 64 };
+
+    bool decode(const QByteArray &packet, BCSnapshot *snapshot);
+
+private:
+    QMap<quint32, BCSnapshot> m_history;
+};
+
+// Streams board snapshots into a file or a socket as length-prefixed
+// packets. Files acknowledge every packet (each one is kept), sockets wait
+// for the spectator to send back the acknowledged tick as a quint32.
+class BCSnapshotRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    BCSnapshotRecorder(BCBoard *board, QIODevice *device, QObject *parent = 0);
+
+    void setInterval(int ticks) { m_interval = qMax(1, ticks); }
+    void setAutoAcknowledge(bool autoAcknowledge) { m_autoAcknowledge = autoAcknowledge; }
+
+    quint64 bytesWritten() const { return m_bytesWritten; }
+
+public slots:
+    void record();
+
+private slots:
+    void readAcknowledgements();
+
+private:
+    BCBoard *m_board;
+    QPointer<QIODevice> m_device;
+    BCSnapshotEncoder m_encoder;
+    int m_interval;
+    bool m_autoAcknowledge;
+    quint64 m_bytesWritten;
+};
+
+#endif // BCSNAPSHOT_H
@@ -0,0 +1,160 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "bcspawnscheduler.h"
+
+static const quint8 bonusBit = 0x04;
+
+BCSpawnScheduler::BCSpawnScheduler() :
+    m_endless(false),
+    m_spawned(0),
+    m_wave(0),
+    m_waveSpawned(0),
+    m_nextSpawnTick(0)
+{
+    m_waves << Wave();
+    setDefaultRoster();
+}
+
+void BCSpawnScheduler::setRosterCount(int count)
+{
+    m_roster.resize(qMax(0, count));
+}
+
+BattleCity::TankType BCSpawnScheduler::tankType(int index) const
+{
+    if (index < 0 || index >= m_roster.size())
+        return BattleCity::Basic;
+    return BattleCity::TankType(BattleCity::Basic + (quint8(m_roster.at(index)) & 0x03));
+}
+
+bool BCSpawnScheduler::bonus(int index) const
+{
+    if (index < 0 || index >= m_roster.size())
+        return false;
+    return quint8(m_roster.at(index)) & bonusBit;
+}
+
+void BCSpawnScheduler::setEntry(int index, BattleCity::TankType type, bool bonus)
+{
+    if (index < 0 || index >= m_roster.size())
+        return;
+    const quint8 entry = quint8((type - BattleCity::Basic) & 0x03) | (bonus ? bonusBit : 0);
+    if (quint8(m_roster.at(index)) != entry)
+        m_roster[index] = char(entry);
+}
+
+void BCSpawnScheduler::setDefaultRoster()
+{
+    static const BattleCity::TankType tanks[] = {
+        BattleCity::Basic, BattleCity::Basic,
+        BattleCity::Fast, BattleCity::Fast,
+        BattleCity::Basic, BattleCity::Basic,
+        BattleCity::Power, BattleCity::Power,
+        BattleCity::Fast, BattleCity::Fast,
+        BattleCity::Power, BattleCity::Power,
+        BattleCity::Basic, BattleCity::Basic,
+        BattleCity::Fast, BattleCity::Fast,
+        BattleCity::Power, BattleCity::Power,
+        BattleCity::Armor, BattleCity::Armor
+    };
+    static const int count = int(sizeof(tanks) / sizeof(tanks[0]));
+
+    setRosterCount(count);
+    for (int i = 0; i < count; ++i)
+        setEntry(i, tanks[i], i % 6 == 5);
+}
+
+void BCSpawnScheduler::setWaves(const QList<Wave> &waves)
+{
+    m_waves.clear();
+    foreach (const Wave &wave, waves)
+        m_waves << Wave(qMax(0, wave.count), qMax(1, wave.maxActive), qMax(0, wave.interval));
+    if (m_waves.isEmpty())
+        m_waves << Wave();
+    rewind();
+}
+
+void BCSpawnScheduler::rewind()
+{
+    m_spawned = 0;
+    m_wave = 0;
+    m_waveSpawned = 0;
+    m_nextSpawnTick = 0;
+}
+
+int BCSpawnScheduler::remaining() const
+{
+    if (m_endless)
+        return -1;
+    return qMax(0, m_roster.size() - int(m_spawned));
+}
+
+int BCSpawnScheduler::next(quint32 tick, int active)
+{
+    if (m_roster.isEmpty() || !remaining() || tick < m_nextSpawnTick)
+        return -1;
+
+    // The last wave keeps going with the rest of the roster, unless the
+    // schedule is endless, then it starts over once the board is clear.
+    const Wave &wave = m_waves.at(m_wave);
+    if (wave.count && m_waveSpawned >= wave.count) {
+        const bool last = m_wave + 1 == m_waves.count();
+        if (!last || m_endless) {
+            if (active)
+                return -1;
+            if (!last)
+                ++m_wave;
+            m_waveSpawned = 0;
+        }
+    }
+
+    if (active >= m_waves.at(m_wave).maxActive)
+        return -1;
+    return int(m_spawned % quint32(m_roster.size()));
+}
+
+void BCSpawnScheduler::spawned(quint32 tick)
+{
+    ++m_spawned;
+    ++m_waveSpawned;
+    m_nextSpawnTick = tick + m_waves.at(m_wave).interval;
+}
+
+QDataStream &operator << (QDataStream &out, const BCSpawnScheduler &scheduler)
+{
+    out << scheduler.m_roster << scheduler.m_waves.count();
+    foreach (const BCSpawnScheduler::Wave &wave, scheduler.m_waves)
+        out << wave.count << wave.maxActive << wave.interval;
+    return out << scheduler.m_endless << scheduler.m_spawned << scheduler.m_wave
+               << scheduler.m_waveSpawned << scheduler.m_nextSpawnTick;
+}
+
+QDataStream &operator >> (QDataStream &in, BCSpawnScheduler &scheduler)
+{
+    int count = 0;
+    in >> scheduler.m_roster >> count;
+    QList<BCSpawnScheduler::Wave> waves;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        BCSpawnScheduler::Wave wave;
+        in >> wave.count >> wave.maxActive >> wave.interval;
+        waves << wave;
+    }
+    scheduler.setWaves(waves);
+    in >> scheduler.m_endless >> scheduler.m_spawned >> scheduler.m_wave
+       >> scheduler.m_waveSpawned >> scheduler.m_nextSpawnTick;
+    scheduler.m_wave = qBound(0, scheduler.m_wave, scheduler.m_waves.count() - 1);
+    return in;
+}
@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCSPAWNSCHEDULER_H
+#define BCSPAWNSCHEDULER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QDataStream>
+
+#include "bcglobal.h"
+
+// Decides which roster entry enters the board and when. The roster is one
+// byte per tank, so its size does not matter to the board: only the tanks
+// that are on the board at the same time exist as items. Waves split the
+// roster, a wave starts once every tank of the previous one is gone.
+class BCSpawnScheduler
+{
+    friend QDataStream &operator << (QDataStream &out, const BCSpawnScheduler &scheduler);
+    friend QDataStream &operator >> (QDataStream &in, BCSpawnScheduler &scheduler);
+public:
+    struct Wave
+    {
+        Wave(int count = 0, int maxActive = 4, int interval = 90) :
+            count(count), maxActive(maxActive), interval(interval) { }
+
+        int count;      // roster entries of the wave, 0 for the rest of the roster
+        int maxActive;  // tanks of the wave on the board at once
+        int interval;   // ticks between two spawns
+    };
+
+    BCSpawnScheduler();
+
+    int rosterCount() const { return m_roster.size(); }
+    void setRosterCount(int count);
+    BattleCity::TankType tankType(int index) const;
+    bool bonus(int index) const;
+    void setEntry(int index, BattleCity::TankType type, bool bonus);
+    void setDefaultRoster();
+
+    QList<Wave> waves() const { return m_waves; }
+    void setWaves(const QList<Wave> &waves);
+
+    // Endless schedules cycle through the roster and repeat the last wave.
+    void setEndless(bool endless) { m_endless = endless; }
+    bool endless() const { return m_endless; }
+
+    void rewind();
+
+    // Roster index of the tank to spawn at the tick with active tanks on the
+    // board, or -1. spawned() commits the spawn once the board placed it.
+    int next(quint32 tick, int active);
+    void spawned(quint32 tick);
+
+    quint32 spawnedCount() const { return m_spawned; }
+    int remaining() const;
+    int currentWave() const { return m_wave; }
+    quint32 nextSpawnTick() const { return m_nextSpawnTick; }
+
+private:
+    QByteArray m_roster;    // type - Basic in bits 0-1, bonus in bit 2
+    QList<Wave> m_waves;
+    bool m_endless;
+
+    quint32 m_spawned;
+    int m_wave;
+    int m_waveSpawned;
+    quint32 m_nextSpawnTick;
+};
+
+QDataStream &operator << (QDataStream &out, const BCSpawnScheduler &scheduler);
+QDataStream &operator >> (QDataStream &in, BCSpawnScheduler &scheduler);
+
+#endif // BCSPAWNSCHEDULER_H
@@ -0,0 +1,191 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QVector>
+
+#include "bcstagegenerator.h"
+#include "bcboard.h"
+#include "bcmapvalidator.h"
+
+static const quint8 ground = BattleCity::Ground - BattleCity::Ground;
+static const quint8 bricks = BattleCity::BricksWall - BattleCity::Ground;
+static const quint8 concrete = BattleCity::ConcreteWall - BattleCity::Ground;
+static const quint8 ice = BattleCity::Ice - BattleCity::Ground;
+static const quint8 camouflage = BattleCity::Camouflage - BattleCity::Ground;
+static const quint8 water = BattleCity::Water - BattleCity::Ground;
+
+// Obstacle cells of a board cell: top left, top right, bottom left, bottom right.
+static const quint8 blockMasks[] = { 0x0f, 0x03, 0x0c, 0x05, 0x0a };
+
+BCStageGenerator::BCStageGenerator(int boardSize, quint32 seed) :
+    m_boardSize(qBound(BCMapValidator::minBoardSize, boardSize, BCMapValidator::maxBoardSize)),
+    m_random(seed)
+{
+}
+
+quint32 BCStageGenerator::random()
+{
+    // Same LCG as the board, stages only depend on the seed.
+    m_random = m_random * 1103515245u + 12345u;
+    return m_random >> 16;
+}
+
+QByteArray BCStageGenerator::generate()
+{
+    QByteArray tiles;
+    for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+        layout(tiles);
+        if (playable(tiles, m_boardSize, BCBoard::maxPlayers))
+            return tiles;
+    }
+    return QByteArray();
+}
+
+void BCStageGenerator::fillBlock(QByteArray &tiles, int row, int column, quint8 tile, quint8 mask)
+{
+    const int size = gridSize();
+    char *cell = tiles.data() + 2 * row * size + 2 * column;
+    if (mask & 0x01)
+        cell[0] = tile;
+    if (mask & 0x02)
+        cell[1] = tile;
+    if (mask & 0x04)
+        cell[size] = tile;
+    if (mask & 0x08)
+        cell[size + 1] = tile;
+}
+
+// A random walk of blocks in the left half, off the spawn rows.
+void BCStageGenerator::growRegion(QByteArray &tiles, quint8 tile, int blocks)
+{
+    const int half = (m_boardSize + 1) / 2;
+    const int lastRow = m_boardSize - 2;
+    int row = 1 + random() % lastRow;
+    int column = random() % half;
+    for (int i = 0; i < blocks; ++i) {
+        fillBlock(tiles, row, column, tile);
+        switch (random() % 4) {
+        case 0:
+            row = qMax(1, row - 1);
+            break;
+        case 1:
+            row = qMin(lastRow, row + 1);
+            break;
+        case 2:
+            column = qMax(0, column - 1);
+            break;
+        default:
+            column = qMin(half - 1, column + 1);
+            break;
+        }
+    }
+}
+
+void BCStageGenerator::layout(QByteArray &tiles)
+{
+    const int size = gridSize();
+    tiles.fill(ground, size * size);
+
+    const int half = (m_boardSize + 1) / 2;
+    for (int row = 0; row < m_boardSize; ++row) {
+        for (int column = 0; column < half; ++column) {
+            const int kind = random() % 100;
+            if (kind < 26)
+                fillBlock(tiles, row, column, bricks, blockMasks[random() % 5]);
+            else if (kind < 33)
+                fillBlock(tiles, row, column, concrete, blockMasks[random() % 5]);
+            else if (kind < 37)
+                fillBlock(tiles, row, column, camouflage);
+        }
+    }
+    for (int i = random() % 3; i > 0; --i)
+        growRegion(tiles, water, 2 + random() % 4);
+    for (int i = random() % 3; i > 0; --i)
+        growRegion(tiles, ice, 3 + random() % 6);
+
+    for (int row = 0; row < size; ++row) {
+        char *line = tiles.data() + row * size;
+        for (int column = 0; column < size / 2; ++column)
+            line[size - 1 - column] = line[column];
+    }
+
+    for (int i = 0; i < BCBoard::enemySpawnPoints; ++i)
+        fillBlock(tiles, 0, BCBoard::enemySpawnColumn(m_boardSize, i), ground);
+    for (int i = 0; i < BCBoard::maxPlayers; ++i)
+        fillBlock(tiles, m_boardSize - 1, BCBoard::playerSpawnColumn(m_boardSize, i), ground);
+
+    // Bricks around the falcon, on the three sides off the board edge.
+    const QPoint falcon = BCBoard::falconCell(m_boardSize);
+    for (int row = 2 * falcon.y() - 1; row < size; ++row) {
+        for (int column = 2 * falcon.x() - 1; column <= 2 * falcon.x() + 2; ++column) {
+            const bool inside = row >= 2 * falcon.y() && column >= 2 * falcon.x() && column <= 2 * falcon.x() + 1;
+            if (column >= 0 && column < size)
+                tiles[row * size + column] = char(inside ? ground : bricks);
+        }
+    }
+}
+
+// Tanks are walked from the falcon an obstacle cell at a time, bricks count
+// as open: they are shot through.
+bool BCStageGenerator::playable(const QByteArray &tiles, int boardSize, int players)
+{
+    const int size = 2 * boardSize;
+    if (tiles.size() != size * size)
+        return false;
+
+    QVector<bool> open(size * size);
+    for (int i = 0; i < size * size; ++i) {
+        const quint8 tile = tiles.at(i);
+        open[i] = tile == bricks || !(BCTerrain::flags(tile) & BCTerrain::BlocksTanks);
+    }
+
+    // Top left cells of the tank positions, the tank covers 2x2 cells.
+    const int positions = size - 1;
+    QVector<bool> reached(positions * positions, false);
+    QVector<int> pending;
+    const QPoint falcon = BCBoard::falconCell(boardSize);
+    const int start = 2 * falcon.y() * positions + 2 * falcon.x();
+    pending << start;
+    reached[start] = true;
+    while (!pending.isEmpty()) {
+        const int position = pending.last();
+        pending.pop_back();
+        const int row = position / positions;
+        const int column = position % positions;
+        const int moves[4][2] = { { row - 1, column }, { row + 1, column }, { row, column - 1 }, { row, column + 1 } };
+        for (int i = 0; i < 4; ++i) {
+            const int r = moves[i][0];
+            const int c = moves[i][1];
+            if (r < 0 || r >= positions || c < 0 || c >= positions || reached[r * positions + c])
+                continue;
+            if (!open[r * size + c] || !open[r * size + c + 1] || !open[(r + 1) * size + c] || !open[(r + 1) * size + c + 1])
+                continue;
+            reached[r * positions + c] = true;
+            pending << r * positions + c;
+        }
+    }
+
+    for (int i = 0; i < BCBoard::enemySpawnPoints; ++i) {
+        if (!reached[2 * BCBoard::enemySpawnColumn(boardSize, i)])
+            return false;
+    }
+    for (int i = 0; i < players; ++i) {
+        const int column = 2 * BCBoard::playerSpawnColumn(boardSize, i);
+        if (column < positions && !reached[(size - 2) * positions + column])
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+
+#ifndef BCSTAGEGENERATOR_H
+#define BCSTAGEGENERATOR_H
+
+#include <QByteArray>
+
+// Seeded procedural stages: brick, concrete and camouflage blocks mirrored
+// left to right, water and ice regions, clear spawn points and a brick wall
+// around the falcon. A stage where an enemy spawn point or a player can not
+// reach the falcon, breaking bricks on the way, is thrown away and another
+// one is made. Stages are tile arrays only, BCBoard::loadTiles() plays them.
+class BCStageGenerator
+{
+public:
+    // The board size is kept within the sizes BCMapValidator accepts.
+    explicit BCStageGenerator(int boardSize = 13, quint32 seed = 1);
+
+    int boardSize() const { return m_boardSize; }
+    int gridSize() const { return m_boardSize * 2; }
+
+    void setSeed(quint32 seed) { m_random = seed; }
+
+    static const int maxAttempts = 64;
+
+    // Tile types relative to BattleCity::Ground row by row, empty when no
+    // playable stage came out of maxAttempts.
+    QByteArray generate();
+
+    // The falcon can be reached from the enemy spawn points and those of
+    // the first players.
+    static bool playable(const QByteArray &tiles, int boardSize, int players);
+
+private:
+    quint32 random();
+    void layout(QByteArray &tiles);
+    void fillBlock(QByteArray &tiles, int row, int column, quint8 tile, quint8 mask = 0x0f);
+    void growRegion(QByteArray &tiles, quint8 tile, int blocks);
+
+private:
+    int m_boardSize;
+    quint32 m_random;
+};
+
+#endif // BCSTAGEGENERATOR_H
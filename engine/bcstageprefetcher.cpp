@@ -0,0 +1,63 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QtConcurrentRun>
+
+#include "bcstageprefetcher.h"
+#include "bcmapsmanager.h"
+
+BCStagePrefetcher::BCStagePrefetcher(int depth) :
+    m_depth(qMax(0, depth))
+{
+}
+
+void BCStagePrefetcher::setFileNames(const QStringList &fileNames)
+{
+    if (m_fileNames == fileNames)
+        return;
+    m_fileNames = fileNames;
+    m_stages.clear();
+}
+
+void BCStagePrefetcher::prefetch(int first)
+{
+    const int last = qMin(first + m_depth, m_fileNames.count()) - 1;
+    QMap<int, QFuture<BCStage> >::iterator it = m_stages.begin();
+    while (it != m_stages.end()) {
+        if (it.key() < first || it.key() > last)
+            it = m_stages.erase(it);
+        else
+            ++it;
+    }
+    for (int index = qMax(0, first); index <= last; ++index) {
+        if (!m_stages.contains(index))
+            m_stages.insert(index, QtConcurrent::run(BCMapsManager::readStage, m_fileNames[index]));
+    }
+}
+
+bool BCStagePrefetcher::isReady(int index) const
+{
+    return m_stages.contains(index) && m_stages.value(index).isFinished();
+}
+
+BCStage BCStagePrefetcher::take(int index)
+{
+    if (m_stages.contains(index))
+        return m_stages.take(index).result();
+    if (index < 0 || index >= m_fileNames.count())
+        return BCStage();
+    return BCMapsManager::readStage(m_fileNames[index]);
+}
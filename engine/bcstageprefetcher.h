@@ -0,0 +1,56 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+
+#ifndef BCSTAGEPREFETCHER_H
+#define BCSTAGEPREFETCHER_H
+
+#include <QStringList>
+#include <QFuture>
+#include <QMap>
+
+#include "bcboard.h"
+
+// Reads and validates the stages that come next on the global thread pool
+// while the current one is played, so that changing stages only hands a
+// decoded BCStage to the board.
+class BCStagePrefetcher
+{
+public:
+    explicit BCStagePrefetcher(int depth = 2);
+
+    // Stages decoded ahead.
+    void setDepth(int depth) { m_depth = qMax(0, depth); }
+    int depth() const { return m_depth; }
+
+    void setFileNames(const QStringList &fileNames);
+    QStringList fileNames() const { return m_fileNames; }
+
+    // Starts decoding the stages from first on, the others are forgotten.
+    void prefetch(int first);
+    bool isReady(int index) const;
+
+    // The stage, waiting for its decoding or decoding it now; a null stage
+    // when the file is missing or invalid.
+    BCStage take(int index);
+
+private:
+    QStringList m_fileNames;
+    QMap<int, QFuture<BCStage> > m_stages;
+    int m_depth;
+};
+
+#endif // BCSTAGEPREFETCHER_H
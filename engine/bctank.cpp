@@ -16,19 +16,20 @@
 #include <QPixmapCache>
 #include <QPainter>
 #include <QStyleOptionGraphicsItem>
-#include <QTimer>
 #include <QGraphicsScene>
 
 #include "bctank.h"
 #include "bcboard.h"
+#include "bcboardstate.h"
 
 BCAbstractTank::BCAbstractTank(BattleCity::MoveDirection direction, BCBoard *board) :
-    BCMovableItem(direction, board),
+    BCMovableItem(direction, BCTerrain::BlocksTanks, board),
     m_currentAnimationStep(0),
     m_destroyed(false),
-    m_projectile(0)
+    m_slideTicks(0),
+    m_reloadTick(0)
 {
-
+    setUnitSize(BattleCity::tankUnits);
 }
 
 bool BCAbstractTank::move(BattleCity::MoveDirection direction)
@@ -37,45 +38,64 @@ bool BCAbstractTank::move(BattleCity::MoveDirection direction)
     if (m_currentAnimationStep == BattleCity::tankAnimationSteps)
         m_currentAnimationStep = 0;
 
-    return BCMovableItem::move(direction);
+    const bool moved = BCMovableItem::move(direction);
+    m_slideTicks = moved && (board()->terrain(unitRect()) & BCTerrain::Slippery) ? slideTicks : 0;
+    return moved;
+}
+
+bool BCAbstractTank::slide()
+{
+    if (!m_slideTicks)
+        return false;
+    const quint8 left = m_slideTicks - 1;
+    move(direction());
+    if (m_slideTicks)
+        m_slideTicks = left;
+    return true;
+}
+
+bool BCAbstractTank::covered() const
+{
+    return board()->terrain(unitRect(), true) & BCTerrain::Cover;
 }
 
-void BCAbstractTank::adjustIntersectionPointWithBoardBoundingRect(BattleCity::Edge edge, qreal &x, qreal &y) const
+void BCAbstractTank::adjustIntersectionPointWithBoardBoundingRect(BattleCity::Edge edge, int &x, int &y) const
 {
     switch (edge) {
     case BattleCity::LeftEdge:
         x = 0;
         break;
     case BattleCity::RightEdge:
-        x = board()->implicitWidth() - implicitWidth();// - extraPixel;
+        x = board()->unitSize() - unitRect().width();
         break;
     case BattleCity::TopEdge:
         y = 0;
         break;
     case BattleCity::BottomEdge:
-        y = board()->implicitHeight() - implicitHeight();// - extraPixel;
+        y = board()->unitSize() - unitRect().height();
         break;
     case BattleCity::NoneEdge:
         break;
     }
 }
 
-void BCAbstractTank::adjustIntersectionPointWithObstacle(const BCItem *obstacle, BattleCity::Edge edge, qreal &x, qreal &y) const
+void BCAbstractTank::adjustIntersectionPointWithObstacle(const BCItem *obstacle, BattleCity::Edge edge, int &x, int &y) const
 {
     if (!obstacle)
         return;
+    const QRect &obstacleRect = obstacle->unitRect();
     switch (edge) {
     case BattleCity::LeftEdge:
-        x = obstacle->x() - implicitWidth();
+        x = obstacleRect.x() - unitRect().width();
         break;
     case BattleCity::RightEdge:
-        x = obstacle->x() + obstacle->implicitWidth();
+        x = obstacleRect.x() + obstacleRect.width();
         break;
     case BattleCity::TopEdge:
-        y = obstacle->y() - implicitHeight();
+        y = obstacleRect.y() - unitRect().height();
         break;
     case BattleCity::BottomEdge:
-        y = obstacle->y() + obstacle->implicitHeight();
+        y = obstacleRect.y() + obstacleRect.height();
         break;
     case BattleCity::NoneEdge:
         break;
@@ -84,37 +104,89 @@ void BCAbstractTank::adjustIntersectionPointWithObstacle(const BCItem *obstacle,
 
 void BCAbstractTank::fire()
 {
-    if (m_projectile)
+    const quint32 tick = board()->currentTick();
+    if (tick < m_reloadTick)
+        return;
+
+    BCProjectile *projectile = 0;
+    int flying = 0;
+    foreach (BCProjectile *p, m_projectiles) {
+        if (p->isVisible())
+            ++flying;
+        else if (!projectile)
+            projectile = p;
+    }
+    if (flying >= maxProjectiles())
         return;
-    //TODO: review me
-    m_projectile = new BCProjectile(5.0, direction(), board());
-    m_projectile->setSize(implicitWidth() / 6.0);
+    if (!projectile) {
+        projectile = new BCProjectile(this, board());
+        m_projectiles << projectile;
+    }
+
+    // Centered on the barrel, just outside the tank.
+    const QRect &rect = unitRect();
+    const int size = projectile->unitRect().width();
+    const int center = (rect.width() - size) / 2;
+    QPoint pos;
     if (direction() == BattleCity::Forward) {
-        m_projectile->setPos(x() + (implicitWidth() - m_projectile->implicitWidth()) / 2.0, y() - 5.0);
+        pos = QPoint(rect.x() + center, rect.y() - size);
     } else if (direction() == BattleCity::Backward) {
-        m_projectile->setPos(x() + (implicitWidth() - m_projectile->implicitWidth()) / 2.0, y() + implicitWidth());
+        pos = QPoint(rect.x() + center, rect.y() + rect.height());
     } else if (direction() == BattleCity::Left) {
-        m_projectile->setPos(x() - 5.0, y() + (implicitWidth() - m_projectile->implicitWidth()) / 2.0);
+        pos = QPoint(rect.x() - size, rect.y() + center);
     } else if (direction() == BattleCity::Right) {
-        m_projectile->setPos(x() + implicitWidth(), y() + (implicitWidth() - m_projectile->implicitWidth()) / 2.0);
+        pos = QPoint(rect.x() + rect.width(), rect.y() + center);
     }
-    connect(m_projectile, SIGNAL(exploded()), SLOT(projectileExploded()));
-    m_projectile->launch();
+    projectile->launch(pos, direction(), projectileSpeed());
+    board()->addProjectile(projectile);
+    m_reloadTick = tick + fireInterval();
+}
+
+void BCAbstractTank::reset()
+{
+    m_currentAnimationStep = 0;
+    m_destroyed = false;
+    m_slideTicks = 0;
+    m_reloadTick = 0;
+    foreach (BCProjectile *projectile, m_projectiles)
+        projectile->stop();
 }
 
-void BCAbstractTank::projectileExploded()
+void BCAbstractTank::saveState(BCTankState *state) const
 {
-    delete m_projectile;
+    BCMovableItem::saveState(state);
+    state->type = type();
+    state->animationStep = m_currentAnimationStep;
+    state->destroyed = m_destroyed;
+    state->slideTicks = m_slideTicks;
+    state->reloadTick = m_reloadTick;
+    state->projectilesCount = qMin(m_projectiles.count(), int(BCTankState::MaxProjectiles));
+    for (int i = 0; i < state->projectilesCount; ++i)
+        m_projectiles[i]->saveState(&state->projectiles[i]);
+}
+
+void BCAbstractTank::restoreState(const BCTankState &state)
+{
+    BCMovableItem::restoreState(state);
+    m_currentAnimationStep = state.animationStep;
+    m_destroyed = state.destroyed;
+    m_slideTicks = state.slideTicks;
+    m_reloadTick = state.reloadTick;
+    while (m_projectiles.count() < state.projectilesCount)
+        m_projectiles << new BCProjectile(this, board());
+    for (int i = 0; i < m_projectiles.count(); ++i) {
+        if (i < state.projectilesCount)
+            m_projectiles[i]->restoreState(state.projectiles[i]);
+        else
+            m_projectiles[i]->stop();
+    }
 }
 
 BCEnemyTank::BCEnemyTank(BCBoard *board) :
     BCAbstractTank(BattleCity::Backward, board),
-    m_bonus(false),
-    m_bonusTexture(false),
-    m_timer(new QTimer(this))
+    m_bonus(false)
 {
-    m_timer->setInterval(250);
-    connect(m_timer, SIGNAL(timeout()), SLOT(timerFired()));
+
 }
 
 void BCEnemyTank::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
@@ -124,7 +196,8 @@ void BCEnemyTank::paint(QPainter *painter, const QStyleOptionGraphicsItem *optio
     painter->setPen(Qt::white);
     painter->drawRect(option->rect);
 #else
-    painter->drawPixmap(option->rect, BattleCity::tankTexture(BattleCity::TankType(type()), direction(), currentAnimationStep(), m_bonusTexture));
+    const bool bonusTexture = board()->animator()->frame(this, BCAnimator::BonusBlink) == 0;
+    painter->drawPixmap(option->rect, BattleCity::tankTexture(BattleCity::TankType(type()), direction(), currentAnimationStep(), bonusTexture));
 #endif
 }
 
@@ -133,28 +206,35 @@ void BCEnemyTank::setBonus(bool bonus)
     if (m_bonus == bonus)
         return;
     m_bonus = bonus;
-    m_bonusTexture = m_bonus;
-    update();
-
-    if (m_bonus) {
-        m_timer->start();
-    } else {
-        m_timer->stop();
-    }
+    if (m_bonus)
+        board()->animator()->start(this, BCAnimator::BonusBlink);
+    else
+        board()->animator()->stop(this, BCAnimator::BonusBlink);
     emit bonusChanged();
 }
 
-void BCEnemyTank::timerFired()
+void BCEnemyTank::reset()
 {
-    m_bonusTexture = !m_bonusTexture;
-    update();
-    m_timer->start();
+    BCAbstractTank::reset();
+    setDirection(BattleCity::Backward);
+    setBonus(false);
+}
+
+void BCEnemyTank::saveState(BCTankState *state) const
+{
+    BCAbstractTank::saveState(state);
+    state->bonus = m_bonus;
+}
+
+void BCEnemyTank::restoreState(const BCTankState &state)
+{
+    setBonus(state.bonus);
+    BCAbstractTank::restoreState(state);
 }
 
 BCArmorTank::BCArmorTank(BCBoard *board) :
     BCEnemyTank(board),
-    m_currentHealth(BCArmorTank::health()),
-    m_greenToGoldTexture(false)
+    m_currentHealth(BCArmorTank::health())
 {
 
 }
@@ -169,25 +249,40 @@ void BCArmorTank::hit()
 
     --m_currentHealth;
     if (m_currentHealth > 0) {
-        if (m_currentHealth == health() - 2) {
-            m_timer->start();
-        } else {
-            m_timer->stop();
-        }
+        updateFlash();
         return;
     }
 
-    BCArmorTank::hit();
+    BCEnemyTank::hit();
 }
 
-void BCArmorTank::timerFired()
+void BCArmorTank::reset()
 {
-    if (m_currentHealth == health() - 2) {
-        m_greenToGoldTexture = !m_greenToGoldTexture;
-        update();
-        return;
-    }
-    BCEnemyTank::timerFired();
+    BCEnemyTank::reset();
+    m_currentHealth = health();
+    updateFlash();
+}
+
+void BCArmorTank::saveState(BCTankState *state) const
+{
+    BCEnemyTank::saveState(state);
+    state->health = m_currentHealth;
+}
+
+void BCArmorTank::restoreState(const BCTankState &state)
+{
+    BCEnemyTank::restoreState(state);
+    m_currentHealth = state.health;
+    updateFlash();
+}
+
+// Two hits from the end the tank flashes between green and gold.
+void BCArmorTank::updateFlash()
+{
+    if (m_currentHealth == health() - 2)
+        board()->animator()->start(this, BCAnimator::ArmorFlash);
+    else
+        board()->animator()->stop(this, BCAnimator::ArmorFlash);
 }
 
 void BCArmorTank::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
@@ -206,7 +301,7 @@ void BCArmorTank::paint(QPainter *painter, const QStyleOptionGraphicsItem *optio
     } else if (m_currentHealth == health() - 1) {
         painter->drawPixmap(option->rect, BattleCity::armorTankGoldTexture(direction(), currentAnimationStep()));
     } else if (m_currentHealth == health() - 2) {
-        if (m_greenToGoldTexture) {
+        if (board()->animator()->frame(this, BCAnimator::ArmorFlash) == 1) {
             painter->drawPixmap(option->rect, BattleCity::armorTankGoldTexture(direction(), currentAnimationStep()));
         } else {
             painter->drawPixmap(option->rect, BattleCity::armorTankGreenTexture(direction(), currentAnimationStep()));
@@ -215,6 +310,72 @@ void BCArmorTank::paint(QPainter *painter, const QStyleOptionGraphicsItem *optio
 #endif
 }
 
+BCPlayerTank::BCPlayerTank(BCBoard *board) :
+    BCAbstractTank(BattleCity::Forward, board),
+    m_stars(0),
+    m_lives(defaultLives),
+    m_shieldTick(0)
+{
+
+}
+
+void BCPlayerTank::setLives(int lives)
+{
+    lives = qBound(0, lives, 0xff);
+    if (m_lives == lives)
+        return;
+    m_lives = lives;
+    emit livesChanged();
+}
+
+void BCPlayerTank::setShieldTick(quint32 tick)
+{
+    m_shieldTick = tick;
+    if (shielded())
+        board()->animator()->start(this, BCAnimator::ShieldBlink, tick);
+    else
+        board()->animator()->stop(this, BCAnimator::ShieldBlink);
+}
+
+bool BCPlayerTank::shielded() const
+{
+    return board()->currentTick() < m_shieldTick;
+}
+
+void BCPlayerTank::setStars(int stars)
+{
+    stars = qBound(0, stars, int(maxStars));
+    if (m_stars == stars)
+        return;
+    m_stars = stars;
+    update();
+    emit starsChanged();
+}
+
+void BCPlayerTank::reset()
+{
+    BCAbstractTank::reset();
+    setDirection(BattleCity::Forward);
+    setStars(0);
+    setShieldTick(0);
+}
+
+void BCPlayerTank::saveState(BCTankState *state) const
+{
+    BCAbstractTank::saveState(state);
+    state->stars = m_stars;
+    state->lives = m_lives;
+    state->shieldTick = m_shieldTick;
+}
+
+void BCPlayerTank::restoreState(const BCTankState &state)
+{
+    BCAbstractTank::restoreState(state);
+    setStars(state.stars);
+    setLives(state.lives);
+    setShieldTick(state.shieldTick);
+}
+
 void BCPlayerTank::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
     Q_UNUSED(widget);
@@ -222,6 +383,29 @@ void BCPlayerTank::paint(QPainter *painter, const QStyleOptionGraphicsItem *opti
     painter->setPen(Qt::white);
     painter->drawRect(option->rect);
 #else
-    painter->drawPixmap(option->rect, BattleCity::player1TankTexture(direction(), currentAnimationStep()));
+    switch (m_stars) {
+    case 1:
+        painter->drawPixmap(option->rect, BattleCity::player1TankOneStarTexture(direction(), currentAnimationStep()));
+        break;
+    case 2:
+        painter->drawPixmap(option->rect, BattleCity::player1TankTwoStarsTexture(direction(), currentAnimationStep()));
+        break;
+    case 3:
+        painter->drawPixmap(option->rect, BattleCity::player1TankThreeStarsTexture(direction(), currentAnimationStep()));
+        break;
+    default:
+        painter->drawPixmap(option->rect, BattleCity::player1TankTexture(direction(), currentAnimationStep()));
+        break;
+    }
+    if (shielded()) {
+        QPen pen(Qt::white, 1, Qt::DotLine);
+        pen.setCosmetic(true);
+        // The dots run around the tank.
+        pen.setDashOffset(board()->animator()->frame(this, BCAnimator::ShieldBlink) * 1.5);
+        const int margin = option->rect.width() / 32;
+        painter->setPen(pen);
+        painter->setBrush(Qt::NoBrush);
+        painter->drawEllipse(option->rect.adjusted(margin, margin, -margin, -margin));
+    }
 #endif
 }
@@ -19,11 +19,9 @@
 
 #include "bcitem.h"
 
-#include <QPointer>
-
 class BCBoard;
-class QTimer;
 class BCProjectile;
+struct BCTankState;
 
 class BCAbstractTank : public BCMovableItem
 {
@@ -33,22 +31,41 @@ public:
 
     bool move(BattleCity::MoveDirection direction);
 
+    // Keeps a tank that just left the input on ice going; false once it stopped.
+    bool slide();
+    static const quint8 slideTicks = 6;
+
+    // The tank is entirely under camouflage.
+    bool covered() const;
+
     virtual quint8 health() const { return 1; }
 
-    qreal speed() const { return 5.0; }
+    // Five pixels a tick at the default cell size.
+    int speed() const { return BattleCity::tankUnits / 7; }
 
     virtual void hit() { m_destroyed = true; }
+    void destroy() { m_destroyed = true; }
 
     bool destroyed() const { return m_destroyed; }
 
+    virtual int projectileSpeed() const { return BattleCity::tankUnits / 7; }
+    virtual int maxProjectiles() const { return 1; }
+    virtual quint32 fireInterval() const { return 0; }
+    virtual bool canDestroyConcrete() const { return false; }
+
     virtual void fire();
 
-protected:
-    virtual void adjustIntersectionPointWithBoardBoundingRect(BattleCity::Edge edge, qreal &x, qreal &y) const;
-    virtual void adjustIntersectionPointWithObstacle(const BCItem *obstacle, BattleCity::Edge edge, qreal &x, qreal &y) const;
+    virtual void reset();
+
+    BCProjectile *projectile(int index) const { return m_projectiles.value(index); }
+    int projectileIndex(BCProjectile *projectile) const { return m_projectiles.indexOf(projectile); }
+
+    virtual void saveState(BCTankState *state) const;
+    virtual void restoreState(const BCTankState &state);
 
-private slots:
-    void projectileExploded();
+protected:
+    virtual void adjustIntersectionPointWithBoardBoundingRect(BattleCity::Edge edge, int &x, int &y) const;
+    virtual void adjustIntersectionPointWithObstacle(const BCItem *obstacle, BattleCity::Edge edge, int &x, int &y) const;
 
 protected:
     quint8 currentAnimationStep() const { return m_currentAnimationStep; }
@@ -56,7 +73,9 @@ protected:
 private:
     quint8 m_currentAnimationStep;
     bool m_destroyed;
-    QPointer<BCProjectile> m_projectile;
+    quint8 m_slideTicks;
+    quint32 m_reloadTick;
+    QList<BCProjectile *> m_projectiles;
 };
 
 class BCEnemyTank : public BCAbstractTank
@@ -80,18 +99,16 @@ public:
         setBonus(false);
     }
 
-protected slots:
-    virtual void timerFired();
+    void reset();
+
+    void saveState(BCTankState *state) const;
+    void restoreState(const BCTankState &state);
 
 signals:
     void bonusChanged();
 
 private:
     bool m_bonus;
-    bool m_bonusTexture;
-
-protected:
-    QTimer *m_timer;
 };
 
 class BCBasicTank : public BCEnemyTank
@@ -113,7 +130,7 @@ public:
 
     int type() const { return BattleCity::Fast; }
 
-    qreal speed() const { return 2 * BCEnemyTank::speed(); }
+    int speed() const { return 2 * BCEnemyTank::speed(); }
 };
 
 class BCPowerTank : public BCEnemyTank
@@ -134,29 +151,69 @@ public:
 
     int type() const { return BattleCity::Armor; }
 
-    qreal speed() const { return BCEnemyTank::speed() / 2.0; }
+    int speed() const { return BCEnemyTank::speed() / 2; }
     quint8 health() const { return 4; }
 
     void hit();
 
-    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+    void reset();
+
+    void saveState(BCTankState *state) const;
+    void restoreState(const BCTankState &state);
 
-protected slots:
-    void timerFired();
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
 
 private:
+    void updateFlash();
+
     quint8 m_currentHealth;
-    bool m_greenToGoldTexture;
 };
 
 class BCPlayerTank : public BCAbstractTank
 {
     Q_OBJECT
+
+    Q_PROPERTY(int stars READ stars WRITE setStars NOTIFY starsChanged)
+    Q_PROPERTY(int lives READ lives WRITE setLives NOTIFY livesChanged)
 public:
-    explicit BCPlayerTank(BCBoard *board) :
-        BCAbstractTank(BattleCity::Forward, board) { }
+    explicit BCPlayerTank(BCBoard *board);
+
+    static const quint8 maxStars = 3;
+    static const quint8 defaultLives = 3;
+
+    int type() const { return BattleCity::Player; }
+
+    quint8 stars() const { return m_stars; }
+    void setStars(int stars);
+    void upgrade() { setStars(m_stars + 1); }
+
+    int projectileSpeed() const { return m_stars > 0 ? 2 * BCAbstractTank::projectileSpeed() : BCAbstractTank::projectileSpeed(); }
+    int maxProjectiles() const { return m_stars > 1 ? 2 : 1; }
+    quint32 fireInterval() const { return m_stars > 1 ? 4 : 8; }
+    bool canDestroyConcrete() const { return m_stars == maxStars; }
+
+    quint8 lives() const { return m_lives; }
+    void setLives(int lives);
+
+    // Projectiles do not hurt the tank before the tick.
+    void setShieldTick(quint32 tick);
+    bool shielded() const;
+
+    void reset();
+
+    void saveState(BCTankState *state) const;
+    void restoreState(const BCTankState &state);
 
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
+
+signals:
+    void starsChanged();
+    void livesChanged();
+
+private:
+    quint8 m_stars;
+    quint8 m_lives;
+    quint32 m_shieldTick;
 };
 
 #endif // BCTANK_H
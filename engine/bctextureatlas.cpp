@@ -0,0 +1,127 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QPainter>
+
+#include "bctextureatlas.h"
+#include "bcglobal.h"
+
+static const int tankSlot = BattleCity::Water - BattleCity::Ground + 1;
+static const int tankKinds = 12;
+static const int projectileSlot = tankSlot + tankKinds * 4 * BattleCity::tankAnimationSteps;
+static const int bonusSlot = projectileSlot + 4;
+
+// The letters of BCBonus::paint() as 3x5 bitmaps, a row in the low three
+// bits of each byte: the atlas draws them without the font system.
+static const quint8 bonusGlyphs[BattleCity::TankBonus + 1][5] = {
+    { 7, 4, 7, 1, 7 },  // S
+    { 7, 4, 5, 5, 7 },  // G
+    { 5, 5, 7, 5, 5 },  // H
+    { 7, 4, 6, 4, 4 },  // F
+    { 7, 2, 2, 2, 2 },  // T
+    { 4, 4, 4, 4, 7 }   // L
+};
+
+static int tankTextureSlot(int kind, int direction, int step)
+{
+    return tankSlot + (kind * 4 + direction) * BattleCity::tankAnimationSteps + step;
+}
+
+QRect BCTextureAtlas::slotRect(int slot)
+{
+    return QRect(slot % columns * slotSize, slot / columns * slotSize, slotSize, slotSize);
+}
+
+const QImage &BCTextureAtlas::image()
+{
+    static QImage image;
+    if (!image.isNull())
+        return image;
+
+    const QVector<QImage> textures = BattleCity::textureImages();
+    image = QImage(columns * slotSize, rows * slotSize, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    for (int type = BattleCity::Ground; type <= BattleCity::Water; ++type)
+        painter.drawImage(slotRect(type - BattleCity::Ground),
+                          textures[BattleCity::obstacleTextureId(BattleCity::ObstacleType(type))]);
+
+    for (int d = 0; d < 4; ++d) {
+        const BattleCity::MoveDirection direction = BattleCity::MoveDirection(d);
+        for (int step = 0; step < BattleCity::tankAnimationSteps; ++step) {
+            for (int type = BattleCity::Basic; type <= BattleCity::Armor; ++type) {
+                const int kind = type - BattleCity::Basic;
+                const BattleCity::TankTextureSet set = BattleCity::TankTextureSet(2 * kind);
+                painter.drawImage(slotRect(tankTextureSlot(kind, d, step)),
+                                  textures[BattleCity::tankTextureId(set, direction, step)]);
+                painter.drawImage(slotRect(tankTextureSlot(kind + 4, d, step)),
+                                  textures[BattleCity::tankTextureId(BattleCity::TankTextureSet(set + 1), direction, step)]);
+            }
+            for (int stars = 0; stars < 4; ++stars) {
+                const BattleCity::TankTextureSet set = BattleCity::TankTextureSet(BattleCity::PlayerTankTextures + stars);
+                painter.drawImage(slotRect(tankTextureSlot(8 + stars, d, step)),
+                                  textures[BattleCity::tankTextureId(set, direction, step)]);
+            }
+        }
+        painter.drawImage(slotRect(projectileSlot + d), textures[BattleCity::projectileTextureId(direction)]);
+    }
+
+    // Same stand-in as BCBonus::paint(): a framed letter, two texels a dot.
+    const int dot = 2;
+    for (int type = BattleCity::StarBonus; type <= BattleCity::TankBonus; ++type) {
+        const QRect rect = slotRect(bonusSlot + type);
+        painter.setPen(Qt::white);
+        painter.setBrush(QColor(0x60, 0x20, 0x20));
+        painter.drawRect(rect.adjusted(0, 0, -1, -1));
+        const QPoint origin = rect.center() - QPoint(3 * dot / 2, 5 * dot / 2) + QPoint(1, 1);
+        for (int row = 0; row < 5; ++row) {
+            for (int column = 0; column < 3; ++column) {
+                if (bonusGlyphs[type][row] & (4 >> column))
+                    painter.fillRect(origin.x() + column * dot, origin.y() + row * dot, dot, dot, Qt::white);
+            }
+        }
+    }
+    return image;
+}
+
+int BCTextureAtlas::actorSlot(const BCSnapshot::Actor &actor)
+{
+    if (!(actor.state & 0x04))
+        return -1;
+    const int direction = actor.state & 0x03;
+    if (actor.type == BCSnapshot::projectileType)
+        return projectileSlot + direction;
+
+    // Snapshots carry no animation step, tracks follow the position instead.
+    const int step = (actor.x + actor.y) / 4 % BattleCity::tankAnimationSteps;
+    const int type = BattleCity::Ground + actor.type;
+    switch (type) {
+    case BattleCity::Basic:
+    case BattleCity::Fast:
+    case BattleCity::Power:
+    case BattleCity::Armor:
+        return tankTextureSlot(type - BattleCity::Basic + (actor.state & 0x08 ? 4 : 0), direction, step);
+    case BattleCity::Player:
+        return tankTextureSlot(8 + qMin((actor.state >> 4) & 0x07, 3), direction, step);
+    case BattleCity::Bonus:
+        return bonusSlot + qMin((actor.state >> 4) & 0x07, int(BattleCity::TankBonus));
+    case BattleCity::Falcon:
+    case BattleCity::FalconDestroyed:
+        return type - BattleCity::Ground;
+    default:
+        return -1;
+    }
+}
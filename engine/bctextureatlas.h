@@ -0,0 +1,49 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+
+#ifndef BCTEXTUREATLAS_H
+#define BCTEXTUREATLAS_H
+
+#include <QImage>
+#include <QRect>
+
+#include "bcsnapshot.h"
+
+// Every texture of the board in one image of slotSize texels slots: obstacles
+// first (by type), then 12 kinds of tanks (Basic to Armor, their bonus look,
+// the player with 0 to 3 stars) in 4 directions and 2 steps, projectiles,
+// power-ups. The views that draw snapshots share it.
+class BCTextureAtlas
+{
+public:
+    static const int slotSize = 16;
+    static const int columns = 16;
+    static const int rows = 8;
+
+    // Made of BattleCity::textureImages() rather than the pixmap cache and
+    // drawn without fonts, so that it also works without a GUI. Built on
+    // first use, the first exported frame, in the main thread.
+    static const QImage &image();
+
+    static QRect slotRect(int slot);
+
+    // Atlas slot of a snapshot tile or actor, -1 for nothing to draw.
+    static int tileSlot(char tile) { return tile; }
+    static int actorSlot(const BCSnapshot::Actor &actor);
+};
+
+#endif // BCTEXTUREATLAS_H
@@ -0,0 +1,53 @@
+# Game engine shared by the QML application and the headless tools.
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+QT += declarative network
+
+SOURCES += \
+    $$PWD/bcboard.cpp \
+    $$PWD/bcitem.cpp \
+    $$PWD/bcmapsmanager.cpp \
+    $$PWD/bctank.cpp \
+    $$PWD/bcglobal.cpp \
+    $$PWD/bcarena.cpp \
+    $$PWD/bccontroller.cpp \
+    $$PWD/bclockstep.cpp \
+    $$PWD/bcsnapshot.cpp \
+    $$PWD/bcboardstate.cpp \
+    $$PWD/bcspawnscheduler.cpp \
+    $$PWD/bclanemap.cpp \
+    $$PWD/bctextureatlas.cpp \
+    $$PWD/bcframeexporter.cpp \
+    $$PWD/bceditjournal.cpp \
+    $$PWD/bcstagegenerator.cpp \
+    $$PWD/bcmapvalidator.cpp \
+    $$PWD/bcstageprefetcher.cpp \
+    $$PWD/bcanimator.cpp \
+    $$PWD/bceffects.cpp
+
+HEADERS += \
+    $$PWD/bcboard.h \
+    $$PWD/bcitem.h \
+    $$PWD/bcmapsmanager.h \
+    $$PWD/bctank.h \
+    $$PWD/bcglobal.h \
+    $$PWD/bcarena.h \
+    $$PWD/bccontroller.h \
+    $$PWD/bclockstep.h \
+    $$PWD/bcsnapshot.h \
+    $$PWD/bcboardstate.h \
+    $$PWD/bcspawnscheduler.h \
+    $$PWD/bclanemap.h \
+    $$PWD/bctextureatlas.h \
+    $$PWD/bcframeexporter.h \
+    $$PWD/bceditjournal.h \
+    $$PWD/bcstagegenerator.h \
+    $$PWD/bcmapvalidator.h \
+    $$PWD/bcstageprefetcher.h \
+    $$PWD/bcanimator.h \
+    $$PWD/bceffects.h
+
+# QtConcurrent is a module of its own in Qt 5.
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
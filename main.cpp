@@ -3,6 +3,68 @@
 
 #include "qmlapplicationviewer.h"
 #include "engine/bcglobal.h"
+#include "engine/bcboard.h"
+#include "engine/bclockstep.h"
+#include "engine/bcsnapshot.h"
+
+// Lockstep over loopback, e.g.:
+//   battlecity --player 0 --port 45000 --peer 127.0.0.1:45001:1
+//   battlecity --player 1 --port 45001 --peer 127.0.0.1:45000:0
+// Reports the first desync of a lockstep session: from then on the peers
+// no longer play the same game.
+class BCDesyncReporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BCDesyncReporter(BCLockstepSession *session) :
+        QObject(session), m_reported(false)
+    {
+        connect(session, SIGNAL(desyncDetected(quint32)), SLOT(desyncDetected(quint32)));
+    }
+
+private slots:
+    void desyncDetected(quint32 tick)
+    {
+        if (m_reported)
+            return;
+        m_reported = true;
+        qWarning("Lockstep: desync detected at tick %u", tick);
+    }
+
+private:
+    bool m_reported;
+};
+
+static BCLockstepSession *createLockstepSession(const QStringList &arguments, BCBoard *board)
+{
+    const int portIndex = arguments.indexOf("--port");
+    if (!board || portIndex < 0 || portIndex + 1 >= arguments.count())
+        return 0;
+
+    const int playerIndex = arguments.indexOf("--player");
+    const int player = playerIndex >= 0 ? arguments.value(playerIndex + 1).toInt() : 0;
+
+    BCLockstepSession *session = new BCLockstepSession(board, player, board);
+    if (!session->bind(QHostAddress::Any, arguments[portIndex + 1].toUShort())) {
+        qWarning("Lockstep: can't bind port %s", qPrintable(arguments[portIndex + 1]));
+        delete session;
+        return 0;
+    }
+
+    const int delayIndex = arguments.indexOf("--input-delay");
+    if (delayIndex >= 0)
+        session->setInputDelay(arguments.value(delayIndex + 1).toInt());
+
+    for (int i = 0; i < arguments.count() - 1; ++i) {
+        if (arguments[i] != "--peer")
+            continue;
+        const QStringList peer = arguments[i + 1].split(':');
+        if (peer.count() == 3)
+            session->addPeer(QHostAddress(peer[0]), peer[1].toUShort(), peer[2].toInt());
+    }
+    new BCDesyncReporter(session);
+    return session;
+}
 
 Q_DECL_EXPORT int main(int argc, char *argv[])
 {
@@ -18,5 +80,21 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
     viewer->setMainQmlFile(QLatin1String("qml/battlecity/main.qml"));
     viewer->showExpanded();
 
+    BCBoard *board = viewer->rootObject() ? viewer->rootObject()->findChild<BCBoard *>() : 0;
+    BCLockstepSession *session = createLockstepSession(app->arguments(), board);
+    if (session)
+        session->start();
+
+    const int recordIndex = app->arguments().indexOf("--record");
+    if (board && recordIndex >= 0 && recordIndex + 1 < app->arguments().count()) {
+        QFile *file = new QFile(app->arguments()[recordIndex + 1], board);
+        if (file->open(QIODevice::WriteOnly))
+            new BCSnapshotRecorder(board, file, board);
+        else
+            qWarning("Can't open %s for recording", qPrintable(file->fileName()));
+    }
+
     return app->exec();
 }
+
+#include "main.moc"
@@ -0,0 +1,420 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QCoreApplication>
+#include <QProcess>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTextStream>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "bcmatchrunner.h"
+#include "bcboard.h"
+#include "bctank.h"
+#include "bcmapsmanager.h"
+#include "bcframeexporter.h"
+#include "bcsnapshot.h"
+#include "bcstagegenerator.h"
+
+const QString generatedPrefix = "generated:";
+
+static const char *outcomeNames[] = { "won", "lost", "timeout", "failed" };
+
+// CPU time of the calling thread, so that the other matches running at once
+// do not show in the tick timings.
+static qint64 threadCpuNs()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+    const quint64 kernelTime = quint64(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime;
+    const quint64 userTime = quint64(user.dwHighDateTime) << 32 | user.dwLowDateTime;
+    return qint64(kernelTime + userTime) * 100;
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+        return 0;
+    return qint64(time.tv_sec) * 1000000000 + time.tv_nsec;
+#endif
+}
+
+static QString jsonString(const QString &value)
+{
+    QString escaped = value;
+    escaped.replace('\\', "\\\\").replace('"', "\\\"");
+    return '"' + escaped + '"';
+}
+
+QString BCMatchResult::toLine() const
+{
+    return QString("%1 %2 %3 %4 %5").arg(outcomeNames[outcome]).arg(ticks).arg(falconTick)
+            .arg(meanTickUs, 0, 'f', 3).arg(maxTickUs, 0, 'f', 3);
+}
+
+BCMatchResult BCMatchResult::fromLine(const QString &line)
+{
+    BCMatchResult result;
+    const QStringList fields = line.simplified().split(' ');
+    if (fields.count() != 5)
+        return result;
+    for (int i = Won; i <= Failed; ++i) {
+        if (fields[0] == outcomeNames[i])
+            result.outcome = Outcome(i);
+    }
+    result.ticks = fields[1].toUInt();
+    result.falconTick = fields[2].toLongLong();
+    result.meanTickUs = fields[3].toDouble();
+    result.maxTickUs = fields[4].toDouble();
+    return result;
+}
+
+// Wanders around, turns when stuck, and fires at enemies in its lane and
+// now and then at walls.
+class BCMatchBot
+{
+public:
+    BCMatchBot() : m_random(1), m_direction(BattleCity::Forward), m_turnTick(0) { }
+
+    void setSeed(quint32 seed) { m_random = seed; }
+    BCInputFrame frame(BCBoard *board, int player);
+
+private:
+    quint32 random()
+    {
+        m_random = m_random * 1103515245u + 12345u;
+        return m_random >> 16;
+    }
+
+    quint32 m_random;
+    BattleCity::MoveDirection m_direction;
+    quint32 m_turnTick;
+    QPoint m_lastPos;
+};
+
+BCInputFrame BCMatchBot::frame(BCBoard *board, int player)
+{
+    BCInputState input;
+    const BCPlayerTank *tank = board->playerTank(player);
+    if (!tank || tank->destroyed())
+        return input.frame();
+
+    bool fire = false;
+    for (int i = 0; i < BCBoard::maxActiveEnemies && !fire; ++i) {
+        const BCEnemyTank *enemy = board->enemyTank(i);
+        fire = enemy && !enemy->destroyed() && board->canHit(tank, enemy);
+    }
+    if (!fire && board->nearestDestructible(tank))
+        fire = random() % 4 == 0;
+
+    if (tank->unitRect().topLeft() == m_lastPos || board->currentTick() >= m_turnTick) {
+        m_direction = BattleCity::MoveDirection(random() % 4);
+        m_turnTick = board->currentTick() + 32 + random() % 64;
+    }
+    m_lastPos = tank->unitRect().topLeft();
+
+    input.direction = m_direction;
+    if (fire)
+        input.held |= 1 << BCController::Fire;
+    return input.frame();
+}
+
+// Frames from a script: each "tick player frame" line sets the frame the
+// player holds from that tick on. Lines starting with # are comments.
+class BCMatchScript
+{
+public:
+    BCMatchScript() : m_next(0), m_players(0) { }
+
+    bool load(const QString &fileName);
+
+    bool controls(int player) const { return m_players & (1 << player); }
+    void apply(quint32 tick, BCInputFrame *frames);
+
+private:
+    struct Entry
+    {
+        quint32 tick;
+        int player;
+        BCInputFrame frame;
+    };
+
+    static bool lessThan(const Entry &a, const Entry &b) { return a.tick < b.tick; }
+
+    QList<Entry> m_entries;
+    int m_next;
+    quint32 m_players;
+};
+
+bool BCMatchScript::load(const QString &fileName)
+{
+    m_entries.clear();
+    m_next = 0;
+    m_players = 0;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const QString line = in.readLine().simplified();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        const QStringList fields = line.split(' ');
+        if (fields.count() != 3)
+            return false;
+        Entry entry;
+        entry.tick = fields[0].toUInt();
+        entry.player = fields[1].toInt();
+        entry.frame = BCInputFrame(fields[2].toUInt());
+        if (entry.player < 0 || entry.player >= BCBoard::maxPlayers)
+            return false;
+        m_players |= 1 << entry.player;
+        m_entries << entry;
+    }
+    qStableSort(m_entries.begin(), m_entries.end(), lessThan);
+    return true;
+}
+
+void BCMatchScript::apply(quint32 tick, BCInputFrame *frames)
+{
+    while (m_next < m_entries.count() && m_entries[m_next].tick <= tick) {
+        frames[m_entries[m_next].player] = m_entries[m_next].frame;
+        ++m_next;
+    }
+}
+
+BCMatchResult runMatch(const QString &map, quint32 seed, const BCMatchOptions &options)
+{
+    BCMatchResult result;
+
+    BCMatchScript script;
+    if (!options.script.isEmpty() && !script.load(options.script))
+        return result;
+
+    BCBoard board;
+    board.setAutoTick(false);
+    if (map.startsWith(generatedPrefix)) {
+        BCStageGenerator generator(board.boardSize(), map.mid(generatedPrefix.size()).toUInt());
+        const QByteArray tiles = generator.generate();
+        if (tiles.isEmpty())
+            return result;
+        board.loadTiles(generator.boardSize(), tiles);
+    } else if (!BCMapsManager::readMap(map, &board)) {
+        return result;
+    }
+    board.setPlayersCount(options.players);
+    board.setSeed(seed);
+
+    BCMatchBot bots[BCBoard::maxPlayers];
+    for (int i = 0; i < BCBoard::maxPlayers; ++i)
+        bots[i].setSeed(seed * 31 + i);
+
+    BCInputFrame frames[BCBoard::maxPlayers];
+    BCInputFrame scripted[BCBoard::maxPlayers];
+    for (int i = 0; i < BCBoard::maxPlayers; ++i)
+        scripted[i] = BCInputState().frame();
+
+    // Frames are written out of the timed step.
+    BCFrameExporter exporter;
+    if (!options.frames.isEmpty()) {
+        const QString name = QString("%1-%2").arg(QFileInfo(map).completeBaseName()).arg(seed);
+        const QString path = QDir(options.frames).filePath(options.y4m ? name + ".y4m" : name);
+        QDir().mkpath(options.frames);
+        exporter.setTileSize(options.tileSize);
+        exporter.setInterval(options.frameInterval);
+        if (!exporter.open(path, options.y4m ? BCFrameExporter::Y4m : BCFrameExporter::PngSequence))
+            return result;
+        exporter.writeFrame(BCSnapshot::capture(&board));
+    }
+
+    qint64 totalNs = 0;
+    qint64 maxNs = 0;
+    result.outcome = BCMatchResult::Timeout;
+    for (int tick = 0; tick < options.ticks; ++tick) {
+        script.apply(board.currentTick(), scripted);
+        for (int i = 0; i < board.playersCount(); ++i)
+            frames[i] = script.controls(i) ? scripted[i] : bots[i].frame(&board, i);
+
+        const qint64 start = threadCpuNs();
+        board.step(frames);
+        const qint64 ns = threadCpuNs() - start;
+        totalNs += ns;
+        maxNs = qMax(maxNs, ns);
+
+        if (!options.frames.isEmpty() && board.currentTick() % exporter.interval() == 0)
+            exporter.writeFrame(BCSnapshot::capture(&board));
+
+        if (board.falconDestroyed()) {
+            result.outcome = BCMatchResult::Lost;
+            result.falconTick = board.currentTick();
+            break;
+        }
+        if (board.playersDefeated()) {
+            result.outcome = BCMatchResult::Lost;
+            break;
+        }
+        if (board.enemiesDefeated()) {
+            result.outcome = BCMatchResult::Won;
+            break;
+        }
+    }
+
+    result.ticks = board.currentTick();
+    result.meanTickUs = result.ticks ? totalNs / 1000.0 / result.ticks : 0;
+    result.maxTickUs = maxNs / 1000.0;
+    return result;
+}
+
+BCMatchRunner::BCMatchRunner(const QStringList &maps, int matches, quint32 seed, QObject *parent) :
+    QObject(parent),
+    m_maps(maps),
+    m_jobs(1),
+    m_results(maps.count())
+{
+    for (int map = 0; map < maps.count(); ++map) {
+        for (int match = 0; match < matches; ++match) {
+            Job job;
+            job.map = map;
+            job.match = match;
+            job.seed = seed + map * 1000003u + match;
+            m_pending << job;
+        }
+    }
+}
+
+void BCMatchRunner::start()
+{
+    startWorkers();
+}
+
+void BCMatchRunner::startWorkers()
+{
+    while (!m_pending.isEmpty() && m_running.count() < m_jobs) {
+        const Job job = m_pending.takeFirst();
+        QProcess *process = new QProcess(this);
+        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(workerFinished()));
+        connect(process, SIGNAL(error(QProcess::ProcessError)), SLOT(workerFinished()));
+        m_running.insert(process, job);
+        process->start(QCoreApplication::applicationFilePath(), QStringList()
+                       << "--worker" << m_maps[job.map] << QString::number(job.seed) << m_workerArguments);
+    }
+    if (m_pending.isEmpty() && m_running.isEmpty())
+        emit finished();
+}
+
+void BCMatchRunner::workerFinished()
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (!process || !m_running.contains(process))
+        return;
+    const Job job = m_running.take(process);
+    BCMatchResult result;
+    if (process->exitStatus() == QProcess::NormalExit)
+        result = BCMatchResult::fromLine(QString::fromLatin1(process->readAllStandardOutput()));
+    m_results[job.map] << result;
+    process->deleteLater();
+    startWorkers();
+}
+
+bool BCMatchRunner::hasFailures() const
+{
+    for (int map = 0; map < m_results.count(); ++map) {
+        if (summary(map).failed)
+            return true;
+    }
+    return false;
+}
+
+BCMatchRunner::Summary BCMatchRunner::summary(int map) const
+{
+    Summary summary;
+    foreach (const BCMatchResult &result, m_results[map]) {
+        switch (result.outcome) {
+        case BCMatchResult::Won:
+            ++summary.won;
+            break;
+        case BCMatchResult::Lost:
+            ++summary.lost;
+            break;
+        case BCMatchResult::Timeout:
+            ++summary.timeout;
+            break;
+        case BCMatchResult::Failed:
+            ++summary.failed;
+            continue;
+        }
+        if (result.falconTick >= 0) {
+            ++summary.falconDestroyed;
+            summary.falconTicks += result.falconTick;
+        }
+        summary.ticks += result.ticks;
+        summary.tickUs += result.meanTickUs * result.ticks;
+        summary.maxTickUs = qMax(summary.maxTickUs, result.maxTickUs);
+    }
+    return summary;
+}
+
+void BCMatchRunner::writeCsv(QIODevice *device) const
+{
+    QTextStream out(device);
+    out << "map,matches,won,lost,timeout,failed,win_rate,falcon_destroyed,mean_ticks_to_falcon,mean_tick_us,max_tick_us\n";
+    for (int map = 0; map < m_maps.count(); ++map) {
+        const Summary s = summary(map);
+        const int played = s.won + s.lost + s.timeout;
+        out << QFileInfo(m_maps[map]).fileName() << ',' << m_results[map].count() << ','
+            << s.won << ',' << s.lost << ',' << s.timeout << ',' << s.failed << ','
+            << (played ? double(s.won) / played : 0.0) << ',' << s.falconDestroyed << ','
+            << (s.falconDestroyed ? double(s.falconTicks) / s.falconDestroyed : 0.0) << ','
+            << (s.ticks ? s.tickUs / s.ticks : 0.0) << ',' << s.maxTickUs << '\n';
+    }
+}
+
+void BCMatchRunner::writeJson(QIODevice *device) const
+{
+    QTextStream out(device);
+    out << "{\n  \"maps\": [";
+    for (int map = 0; map < m_maps.count(); ++map) {
+        const Summary s = summary(map);
+        const int played = s.won + s.lost + s.timeout;
+        out << (map ? ",\n" : "\n") << "    {\n"
+            << "      \"map\": " << jsonString(QFileInfo(m_maps[map]).fileName()) << ",\n"
+            << "      \"matches\": " << m_results[map].count() << ",\n"
+            << "      \"won\": " << s.won << ",\n"
+            << "      \"lost\": " << s.lost << ",\n"
+            << "      \"timeout\": " << s.timeout << ",\n"
+            << "      \"failed\": " << s.failed << ",\n"
+            << "      \"winRate\": " << (played ? double(s.won) / played : 0.0) << ",\n"
+            << "      \"falconDestroyed\": " << s.falconDestroyed << ",\n"
+            << "      \"meanTicksToFalcon\": " << (s.falconDestroyed ? double(s.falconTicks) / s.falconDestroyed : 0.0) << ",\n"
+            << "      \"meanTickUs\": " << (s.ticks ? s.tickUs / s.ticks : 0.0) << ",\n"
+            << "      \"maxTickUs\": " << s.maxTickUs << ",\n"
+            << "      \"results\": [";
+        for (int i = 0; i < m_results[map].count(); ++i) {
+            const BCMatchResult &result = m_results[map][i];
+            out << (i ? ", " : "") << "{ \"outcome\": \"" << outcomeNames[result.outcome]
+                << "\", \"ticks\": " << result.ticks << ", \"falconTick\": " << result.falconTick
+                << ", \"meanTickUs\": " << result.meanTickUs << ", \"maxTickUs\": " << result.maxTickUs << " }";
+        }
+        out << "]\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
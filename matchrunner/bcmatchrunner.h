@@ -0,0 +1,122 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef BCMATCHRUNNER_H
+#define BCMATCHRUNNER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+
+class QProcess;
+class QIODevice;
+
+struct BCMatchOptions
+{
+    BCMatchOptions() : ticks(18000), players(1), y4m(false), frameInterval(1), tileSize(16) { }
+
+    int ticks;          // a match that is not over by then is a timeout
+    int players;
+    QString script;     // "tick player frame" lines, players not in it are bots
+    QString frames;     // directory for the frames of every match, none if empty
+    bool y4m;           // a Y4M file per match instead of a PNG sequence
+    int frameInterval;
+    int tileSize;
+};
+
+struct BCMatchResult
+{
+    enum Outcome { Won, Lost, Timeout, Failed };
+
+    BCMatchResult() : outcome(Failed), ticks(0), falconTick(-1), meanTickUs(0), maxTickUs(0) { }
+
+    QString toLine() const;
+    static BCMatchResult fromLine(const QString &line);
+
+    Outcome outcome;
+    quint32 ticks;
+    qint64 falconTick;  // tick the falcon was destroyed at, -1 if it survived
+    double meanTickUs;
+    double maxTickUs;
+};
+
+// Maps named generatedPrefix + seed are made by BCStageGenerator.
+extern const QString generatedPrefix;
+
+// Plays one match in this process.
+BCMatchResult runMatch(const QString &map, quint32 seed, const BCMatchOptions &options);
+
+// Runs every match of every map in worker processes of this executable,
+// jobs at a time, and aggregates their results per map.
+class BCMatchRunner : public QObject
+{
+    Q_OBJECT
+public:
+    BCMatchRunner(const QStringList &maps, int matches, quint32 seed, QObject *parent = 0);
+
+    void setJobs(int jobs) { m_jobs = qMax(1, jobs); }
+    void setWorkerArguments(const QStringList &arguments) { m_workerArguments = arguments; }
+
+    void start();
+
+    bool hasFailures() const;
+    void writeCsv(QIODevice *device) const;
+    void writeJson(QIODevice *device) const;
+
+signals:
+    void finished();
+
+private slots:
+    void workerFinished();
+
+private:
+    struct Job
+    {
+        int map;
+        int match;
+        quint32 seed;
+    };
+
+    struct Summary
+    {
+        Summary() : won(0), lost(0), timeout(0), failed(0), falconDestroyed(0),
+            falconTicks(0), ticks(0), tickUs(0), maxTickUs(0) { }
+
+        int won;
+        int lost;
+        int timeout;
+        int failed;
+        int falconDestroyed;
+        qint64 falconTicks;
+        qint64 ticks;
+        double tickUs;
+        double maxTickUs;
+    };
+
+    void startWorkers();
+    Summary summary(int map) const;
+
+    QStringList m_maps;
+    QStringList m_workerArguments;
+    int m_jobs;
+
+    QList<Job> m_pending;
+    QHash<QProcess *, Job> m_running;
+    QVector<QList<BCMatchResult> > m_results;
+};
+
+#endif // BCMATCHRUNNER_H
@@ -0,0 +1,148 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QApplication>
+#include <QStringList>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+
+#include "bcmatchrunner.h"
+#include "bcmapvalidator.h"
+
+static const char usage[] =
+        "Usage: matchrunner [options] map.bc...\n"
+        "  --generate N   also play N generated stages, seeds 1 to N\n"
+        "  --validate     only check the maps, in parallel\n"
+        "  --matches N    matches per map (1)\n"
+        "  --jobs N       matches played at once (one per core)\n"
+        "  --ticks N      tick limit of a match (18000)\n"
+        "  --players N    players in a match, 1 to 8 (1)\n"
+        "  --script FILE  \"tick player frame\" input lines, other players are bots\n"
+        "  --seed N       seed of the first match (1)\n"
+        "  --format F     csv or json (csv)\n"
+        "  --output FILE  report file (standard output)\n"
+        "  --frames DIR   PNG frames of every match in DIR/map-seed/\n"
+        "  --y4m          a DIR/map-seed.y4m video per match instead\n"
+        "  --frame-interval N  a frame every N ticks (1)\n"
+        "  --tile-size N  pixels of an obstacle cell in frames (16)\n";
+
+static QString option(const QStringList &arguments, const QString &name, const QString &defaultValue = QString())
+{
+    const int index = arguments.indexOf(name);
+    if (index < 0 || index + 1 >= arguments.count())
+        return defaultValue;
+    return arguments[index + 1];
+}
+
+int main(int argc, char *argv[])
+{
+    // Board items need an application object but no display.
+    QApplication app(argc, argv, false);
+    const QStringList arguments = app.arguments();
+
+    BCMatchOptions options;
+    options.ticks = option(arguments, "--ticks", "18000").toInt();
+    options.players = option(arguments, "--players", "1").toInt();
+    options.script = option(arguments, "--script");
+    options.frames = option(arguments, "--frames");
+    options.y4m = arguments.contains("--y4m");
+    options.frameInterval = qMax(1, option(arguments, "--frame-interval", "1").toInt());
+    options.tileSize = qMax(1, option(arguments, "--tile-size", "16").toInt());
+
+    // Every match runs in a process of its own, started by the runner.
+    if (arguments.value(1) == "--worker") {
+        const BCMatchResult result = runMatch(arguments.value(2), arguments.value(3).toUInt(), options);
+        QTextStream(stdout) << result.toLine() << endl;
+        return result.outcome == BCMatchResult::Failed ? 1 : 0;
+    }
+
+    static const QStringList valued = QStringList() << "--matches" << "--jobs" << "--ticks" << "--players"
+                                                    << "--script" << "--seed" << "--format" << "--output"
+                                                    << "--frames" << "--frame-interval" << "--tile-size"
+                                                    << "--generate";
+    static const QStringList forwarded = QStringList() << "--ticks" << "--players" << "--script"
+                                                       << "--frames" << "--frame-interval" << "--tile-size";
+    QStringList maps;
+    QStringList workerArguments;
+    for (int i = 1; i < arguments.count(); ++i) {
+        if (valued.contains(arguments[i])) {
+            if (forwarded.contains(arguments[i]))
+                workerArguments << arguments[i] << arguments.value(i + 1);
+            ++i;
+        } else if (arguments[i] == "--y4m") {
+            workerArguments << arguments[i];
+        } else if (arguments[i] == "--validate") {
+            continue;
+        } else if (arguments[i].startsWith("--")) {
+            QTextStream(stderr) << usage;
+            return arguments[i] == "--help" ? 0 : 2;
+        } else {
+            maps << arguments[i];
+        }
+    }
+    const int generated = option(arguments, "--generate", "0").toInt();
+    for (int seed = 1; seed <= generated; ++seed)
+        maps << generatedPrefix + QString::number(seed);
+    if (maps.isEmpty()) {
+        QTextStream(stderr) << usage;
+        return 2;
+    }
+
+    if (arguments.contains("--validate")) {
+        // Generated stages have no file to check.
+        QStringList files;
+        foreach (const QString &map, maps) {
+            if (!map.startsWith(generatedPrefix))
+                files << map;
+        }
+        bool valid = true;
+        QTextStream out(stdout);
+        foreach (const BCMapReport &report, BCMapValidator::validateFiles(files)) {
+            out << report.toString() << '\n';
+            valid = valid && report.valid();
+        }
+        return valid ? 0 : 1;
+    }
+
+    const QString format = option(arguments, "--format", "csv");
+    if (format != "csv" && format != "json") {
+        QTextStream(stderr) << "Unknown format " << format << '\n';
+        return 2;
+    }
+
+    BCMatchRunner runner(maps, qMax(1, option(arguments, "--matches", "1").toInt()),
+                         option(arguments, "--seed", "1").toUInt());
+    runner.setJobs(option(arguments, "--jobs", QString::number(QThread::idealThreadCount())).toInt());
+    runner.setWorkerArguments(workerArguments);
+    QObject::connect(&runner, SIGNAL(finished()), &app, SLOT(quit()), Qt::QueuedConnection);
+    runner.start();
+    app.exec();
+
+    const QString outputName = option(arguments, "--output");
+    QFile output(outputName);
+    const bool opened = outputName.isEmpty() ? output.open(stdout, QIODevice::WriteOnly)
+                                             : output.open(QIODevice::WriteOnly);
+    if (!opened) {
+        QTextStream(stderr) << "Can't open " << outputName << '\n';
+        return 1;
+    }
+    if (format == "json")
+        runner.writeJson(&output);
+    else
+        runner.writeCsv(&output);
+
+    return runner.hasFailures() ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+# Headless batch runner: plays matches on maps with bots or scripted input
+# and reports win rates and tick timings.
+
+TEMPLATE = app
+TARGET = matchrunner
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../engine/engine.pri)
+
+# Tick timings read the thread CPU clock.
+unix:!macx: LIBS += -lrt
+
+SOURCES += main.cpp \
+    bcmatchrunner.cpp
+
+HEADERS += \
+    bcmatchrunner.h
+
+# Textures for the frame export.
+RESOURCES += \
+    ../battlecity.qrc
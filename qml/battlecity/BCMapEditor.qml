@@ -12,7 +12,17 @@ Rectangle {
 
         Component.onCompleted: mapsManager.loadMap(mapsManager.maps[0], board)
 
-        onMapLoaded: internal.init()
+        onMapLoaded: {
+            journal.clear();
+            internal.init();
+        }
+        onMapSaved: internal.saveError = ""
+        onMapRejected: internal.saveError = reason
+    }
+
+    BCEditJournal {
+        id: journal
+        board: board
     }
 
     Component.onCompleted: internal.init()
@@ -38,21 +48,34 @@ Rectangle {
                     hoverEnabled: true
 
                     onPositionChanged: {
-                        var cell = board.childAt(mouse.x, mouse.y);
-                        if (!cell)
+                        var cell = board.cellAt(mouse.x, mouse.y);
+                        if (cell.x < 0)
                             return;
-                        boardCursor.x = cell.x + mainLayout.anchors.margins;
-                        boardCursor.y = cell.y + mainLayout.anchors.margins;
-
-                        if (mouseArea.pressed)
-                            board.setObstacleType(cell.row, cell.column, internal.currentObstacle);
+                        boardCursor.x = cell.x * board.obsticaleSize + mainLayout.anchors.margins;
+                        boardCursor.y = cell.y * board.obsticaleSize + mainLayout.anchors.margins;
+
+                        if (mouseArea.pressed) {
+                            // A stroke started off the grid begins at its first cell.
+                            if (internal.lastRow < 0)
+                                journal.paint(cell.y, cell.x, internal.currentObstacle);
+                            else
+                                journal.paintLine(internal.lastRow, internal.lastColumn, cell.y, cell.x, internal.currentObstacle);
+                            internal.lastRow = cell.y;
+                            internal.lastColumn = cell.x;
+                        }
                     }
                     onPressed: {
-                        var cell = board.childAt(mouse.x, mouse.y);
-                        if (!cell)
+                        journal.beginStroke();
+                        internal.lastRow = -1;
+                        internal.lastColumn = -1;
+                        var cell = board.cellAt(mouse.x, mouse.y);
+                        if (cell.x < 0)
                             return;
-                        board.setObstacleType(cell.row, cell.column, internal.currentObstacle);
+                        journal.paint(cell.y, cell.x, internal.currentObstacle);
+                        internal.lastRow = cell.y;
+                        internal.lastColumn = cell.x;
                     }
+                    onReleased: journal.endStroke()
                 }
             }
 
@@ -123,8 +146,8 @@ Rectangle {
 
                     Text {
                         anchors.centerIn: parent
-                        text: qsTr("Save")
-                        color: "white"
+                        text: internal.saveError ? qsTr("Unplayable") : qsTr("Save")
+                        color: internal.saveError ? "red" : "white"
                     }
 
                     MouseArea {
@@ -132,6 +155,60 @@ Rectangle {
                         onClicked: mapsManager.saveMap(board)
                     }
                 }
+
+                Rectangle {
+                    color: "black"
+
+                    width: 80
+                    height: 2 * board.obsticaleSize
+
+                    Text {
+                        anchors.centerIn: parent
+                        text: [qsTr("No mirror"), qsTr("Mirror |"), qsTr("Mirror -"), qsTr("Mirror +")][journal.symmetry]
+                        color: "white"
+                    }
+
+                    MouseArea {
+                        anchors.fill: parent
+                        onClicked: journal.symmetry = (journal.symmetry + 1) % 4
+                    }
+                }
+
+                Rectangle {
+                    color: "black"
+
+                    width: 80
+                    height: 2 * board.obsticaleSize
+
+                    Text {
+                        anchors.centerIn: parent
+                        text: qsTr("Undo")
+                        color: journal.canUndo ? "white" : "gray"
+                    }
+
+                    MouseArea {
+                        anchors.fill: parent
+                        onClicked: journal.undo()
+                    }
+                }
+
+                Rectangle {
+                    color: "black"
+
+                    width: 80
+                    height: 2 * board.obsticaleSize
+
+                    Text {
+                        anchors.centerIn: parent
+                        text: qsTr("Redo")
+                        color: journal.canRedo ? "white" : "gray"
+                    }
+
+                    MouseArea {
+                        anchors.fill: parent
+                        onClicked: journal.redo()
+                    }
+                }
             }
         }
 
@@ -212,6 +289,10 @@ Rectangle {
         id: internal
 
         property int currentObstacle: BattleCity.Ground
+        // Why the last save was refused, empty once a save went through.
+        property string saveError: ""
+        property int lastRow: -1
+        property int lastColumn: -1
         property variant tanks: [BattleCity.Basic, BattleCity.Fast, BattleCity.Power, BattleCity.Armor]
 
         function init()
@@ -226,8 +307,7 @@ Rectangle {
 
             tanksModel.clear();
             for (var index = 0; index < board.enemyTanksCount; ++index) {
-                var tank = board.enemyTank(index);
-                tanksModel.append({"bonus": tank.bonus, "type": tank.type, "index": index});
+                tanksModel.append({"bonus": board.enemyTankBonus(index), "type": board.enemyTankType(index), "index": index});
             }
         }
 
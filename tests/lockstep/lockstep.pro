@@ -0,0 +1,12 @@
+# Two lockstep sessions talking over loopback.
+
+TEMPLATE = app
+TARGET = tst_bclockstep
+
+QT += testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+include(../../engine/engine.pri)
+
+SOURCES += tst_bclockstep.cpp
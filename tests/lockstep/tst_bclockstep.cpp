@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QtTest/QtTest>
+
+#include "bclockstep.h"
+#include "bcboard.h"
+
+class TestBCLockstep : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void lossyLink();
+    void oneWayOutage();
+
+private:
+    // Runs the event loop until both sessions reach the tick, false on timeout.
+    bool waitForTick(quint32 tick, int timeout);
+
+    BCBoard *m_boards[2];
+    BCLockstepSession *m_sessions[2];
+    int m_desyncs;
+};
+
+static const quint16 basePort = 45170;
+
+void TestBCLockstep::init()
+{
+    m_desyncs = 0;
+    for (int i = 0; i < 2; ++i) {
+        m_boards[i] = new BCBoard;
+        m_sessions[i] = new BCLockstepSession(m_boards[i], i);
+        QVERIFY(m_sessions[i]->bind(QHostAddress::LocalHost, basePort + i));
+        m_sessions[i]->addPeer(QHostAddress::LocalHost, basePort + 1 - i, 1 - i);
+        QSignalSpy *spy = new QSignalSpy(m_sessions[i], SIGNAL(desyncDetected(quint32)));
+        spy->setParent(m_sessions[i]);
+    }
+}
+
+void TestBCLockstep::cleanup()
+{
+    for (int i = 0; i < 2; ++i) {
+        foreach (QSignalSpy *spy, m_sessions[i]->findChildren<QSignalSpy *>())
+            m_desyncs += spy->count();
+        delete m_sessions[i];
+        delete m_boards[i];
+    }
+    QCOMPARE(m_desyncs, 0);
+}
+
+bool TestBCLockstep::waitForTick(quint32 tick, int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (m_sessions[0]->currentTick() < tick || m_sessions[1]->currentTick() < tick) {
+        if (timer.elapsed() > timeout)
+            return false;
+        QTest::qWait(10);
+    }
+    return true;
+}
+
+void TestBCLockstep::lossyLink()
+{
+    m_sessions[0]->setPacketLoss(30);
+    m_sessions[1]->setPacketLoss(30);
+    m_sessions[0]->start();
+    m_sessions[1]->start();
+    QVERIFY(waitForTick(100, 20000));
+}
+
+// Everything one peer sends is lost until the other one stalls; the frames
+// it missed are more than a packet holds and must all be resent.
+void TestBCLockstep::oneWayOutage()
+{
+    m_sessions[0]->setInputDelay(BCLockstepSession::MaxInputDelay);
+    m_sessions[1]->setInputDelay(BCLockstepSession::MaxInputDelay);
+    m_sessions[0]->setPacketLoss(100);
+    m_sessions[0]->start();
+    m_sessions[1]->start();
+    QTest::qWait(3000);
+    const quint32 stalled = m_sessions[1]->currentTick();
+    QVERIFY(stalled < quint32(BCLockstepSession::MaxInputDelay + BCLockstepSession::MaxPrediction + 2));
+
+    m_sessions[0]->setPacketLoss(0);
+    QVERIFY(waitForTick(stalled + 100, 20000));
+}
+
+QTEST_MAIN(TestBCLockstep)
+
+#include "tst_bclockstep.moc"
@@ -0,0 +1,6 @@
+# Unit tests of the engine, run with make check.
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    lockstep
@@ -0,0 +1,41 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Kirill (spirit) Klochkov.
+** Contact: klochkov.kirill@gmail.com
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QApplication>
+#include <QStringList>
+#include <QFile>
+#include <QTextStream>
+
+#include "bcglobal.h"
+
+// Packs the decoded textures into the blob app.pro embeds, so the game
+// maps them at startup instead of decoding the images.
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv, false);
+    const QStringList arguments = app.arguments();
+    if (arguments.count() != 2) {
+        QTextStream(stderr) << "Usage: texturepacker textures.bctx\n";
+        return 2;
+    }
+
+    QFile file(arguments[1]);
+    if (!file.open(QIODevice::WriteOnly) || !BattleCity::writeTextureBlob(&file)) {
+        QTextStream(stderr) << "Can't write " << arguments[1] << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+# Packs the textures into textures.bctx, one pre-decoded premultiplied blob.
+# app.pro runs it at build time, it rebuilds when the images change.
+
+TEMPLATE = app
+TARGET = texturepacker
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../engine/engine.pri)
+
+SOURCES += main.cpp
+
+RESOURCES += \
+    ../battlecity.qrc